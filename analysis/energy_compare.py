@@ -0,0 +1,44 @@
+### Energy conservation comparison between two runs
+### (e.g. double build vs mixed precision build, see makefile target "mixed").
+### Usage: python energy_compare.py <energy.txt of run A> <energy.txt of run B>
+### Prints the relative drift of total energy, |W(t) - W(0)|/W(0), for both runs
+### and plots it against time.
+### The first output is written before the first field solve (E = 0), so W(0)
+### is taken from the second output.
+import sys
+import numpy as np
+import matplotlib.pyplot as plt
+
+def readEnergy(filename):
+    data = np.loadtxt(filename, comments='#')
+    time = data[1:,0]
+    total = data[1:,4]
+    drift = np.absolute(total - total[0])/total[0]
+    return time, total, drift
+
+if len(sys.argv) != 3:
+    print("Usage: python energy_compare.py <energy file A> <energy file B>")
+    sys.exit(1)
+
+fig = plt.figure()
+ax = plt.subplot(111)
+
+for filename in sys.argv[1:]:
+    time, total, drift = readEnergy(filename)
+    print("%s:" % filename)
+    print("    initial energy: %e   final energy: %e" % (total[0], total[-1]))
+    print("    max relative drift: %e   final relative drift: %e" % (drift.max(), drift[-1]))
+    plt.semilogy(time, drift + 1e-16, label=filename)
+
+# Difference between the two runs
+tA, wA, dA = readEnergy(sys.argv[1])
+tB, wB, dB = readEnergy(sys.argv[2])
+n = min(len(wA), len(wB))
+print("max relative difference between runs: %e" % (np.absolute(wA[:n] - wB[:n])/wA[0]).max())
+
+# Axes Labels
+ax.set_xlabel('t')
+ax.set_ylabel('$|W(t) - W(0)|/W(0)$')
+plt.legend()
+plt.grid(True, which='major', color='k', linestyle='-')
+plt.show()
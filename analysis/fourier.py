@@ -16,6 +16,14 @@ for line in inputFile:
             if (totalTime/timestep)%interval != 0:
                 steps+=1
 
+### Output times: from output/times.txt (tagged outputs, uniform or not,
+### see 'U' in input.txt), else every "interval" steps
+try:
+    times = np.loadtxt('../output/times.txt', ndmin=2)[:, 2]
+    steps = len(times)
+except IOError:
+    times = None
+
 ### Allocate array for grid data:
 ### rows -> gridpoints
 ### each column is a different output
@@ -34,7 +42,18 @@ for line in f:
 
 #print timedata_x
 
-t = np.arange(0, totalTime+timestep, timestep*interval) # range: (start, end-not including-, step)
+if times is None:
+    t = np.arange(0, totalTime+timestep, timestep*interval) # range: (start, end-not including-, step)
+    spacing = timestep*interval
+else:
+    ### Non-uniform outputs (adaptive cadence): resampled (linear interpolation)
+    ### on a uniform time axis at the smallest output spacing, for the FFT
+    times = times[:t]
+    timedata_x = timedata_x[:, :t]
+    spacing = np.diff(times).min()
+    t = np.arange(times[0], times[-1] + 0.5*spacing, spacing)
+    if len(t) != len(times) or not np.allclose(t, times):
+        timedata_x = np.array([np.interp(t, times, timedata_x[cell]) for cell in range(0, size)])
 
 # Prepare figure
 fig = plt.figure()
@@ -46,7 +65,7 @@ for cell in range(0, size):
     sp_abs = np.absolute(sp) # Calculate absolute values
     sp_abs_norm = sp_abs/len(sp) # Normalize
 
-    freq = np.fft.fftfreq(len(t), d=timestep*interval) #frequencies (1.0/t)
+    freq = np.fft.fftfreq(len(t), d=spacing) #frequencies (1.0/t)
     omega = 2.0*np.pi*freq #rad freq
     plt.plot(omega, sp_abs_norm)
     
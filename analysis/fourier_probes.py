@@ -0,0 +1,44 @@
+### Frequency spectrum of the probes (input.txt line 'G'): E_x at the probe
+### points, sampled at every time step, so that omega is resolved up to
+### pi/dt (fourier.py only sees every output interval).
+### Usage: python fourier_probes.py [probes.bin]   (default ../output/probes.bin)
+import sys
+import numpy as np
+import matplotlib.pyplot as plt
+
+filename = sys.argv[1] if len(sys.argv) > 1 else '../output/probes.bin'
+
+### Header (see src/probes.c)
+data = open(filename, 'rb').read()
+magic = data[0:4]
+nProbes, nValues, unused = np.frombuffer(data, dtype=np.int32, count=3, offset=4)
+dt = np.frombuffer(data, dtype=np.float64, count=1, offset=16)[0]
+points = np.frombuffer(data, dtype=np.int32, count=nProbes, offset=24)
+start = 24 + 4*nProbes
+recordSize = 1 + nValues*nProbes
+nRecords = (len(data) - start)//(8*recordSize)
+records = np.frombuffer(data, dtype=np.float64, count=nRecords*recordSize, offset=start)
+records = records.reshape(nRecords, recordSize)
+
+t = records[:, 0]
+print("%d probes, %d samples, dt = %g" % (nProbes, nRecords, dt))
+
+# Prepare figure
+fig = plt.figure()
+ax = plt.subplot(111)
+
+# Do FFT (E_x of every probe)
+freq = np.fft.rfftfreq(nRecords, d=dt)
+omega = 2.0*np.pi*freq
+for k in range(nProbes):
+    E_x = records[:, 1 + nValues*k]
+    sp_abs_norm = np.absolute(np.fft.rfft(E_x - E_x.mean()))/nRecords
+    plt.plot(omega, sp_abs_norm, label='grid point %d' % points[k])
+    print("grid point %d: peak at omega = %f" % (points[k], omega[sp_abs_norm.argmax()]))
+
+# Axes Labels
+ax.set_xlabel(r'$\omega$ (rad/sec)')
+ax.set_ylabel('Amplitude')
+plt.legend()
+plt.grid(True)
+plt.show()
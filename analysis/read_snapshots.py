@@ -0,0 +1,73 @@
+### Reads the compressed snapshots (input.txt line 'Z') of output/snapshots.bin.
+### As a module: snapshots = read_snapshots('../output/snapshots.bin') gives a list of
+### dicts with 'output', 'step', 'time' and the arrays 'rho', 'u', 'E_x', 'E_y', 'J_x', 'J_y'.
+### Usage: python read_snapshots.py [snapshots.bin]   (default ../output/snapshots.bin)
+###        prints the snapshots, and their size before and after compression.
+import sys
+import numpy as np
+
+
+### Undoes the run length code (see src/compress.c)
+def run_length_decode(data, n):
+    out = bytearray()
+    i = 0
+    while len(out) < n:
+        c = data[i]
+        if c < 128:
+            out += data[i + 1:i + 2 + c]
+            i += 2 + c
+        else:
+            out += bytes([data[i + 1]])*(c - 125)
+            i += 2
+    return bytes(out)
+
+
+### Undoes the byte planes and the coding of one variable of n values
+def decode_variable(data, n, coding, quantum):
+    planes = np.frombuffer(run_length_decode(data, 8*n), dtype=np.uint8).reshape(8, n)
+    words = np.zeros(n, dtype=np.uint64)
+    for k in range(8):
+        words |= planes[k].astype(np.uint64) << np.uint64(8*k)
+    if coding == 1:
+        # Lossless: XOR with the left neighbour
+        return np.bitwise_xor.accumulate(words).view(np.float64)
+    # Error-bounded: zigzag coded differences of the quanta
+    d = (words >> np.uint64(1)).astype(np.int64) ^ -(words & np.uint64(1)).astype(np.int64)
+    return np.cumsum(d)*quantum
+
+
+def read_snapshots(filename):
+    data = open(filename, 'rb').read()
+    if data[0:4] != b'PICZ':
+        raise ValueError("%s is not a snapshot file" % filename)
+    version, n, n_variables = np.frombuffer(data, dtype=np.int32, count=3, offset=4)
+    dx, x_min = np.frombuffer(data, dtype=np.float64, count=2, offset=16)
+    position = 32
+    snapshots = []
+    while position + 16 <= len(data):
+        output, step = np.frombuffer(data, dtype=np.int32, count=2, offset=position)
+        time = np.frombuffer(data, dtype=np.float64, count=1, offset=position + 8)[0]
+        snapshot = {'output': output, 'step': step, 'time': time, 'dx': dx, 'x_min': x_min}
+        position += 16
+        for v in range(n_variables):
+            name = data[position:position + 8].rstrip(b'\0').decode()
+            coding, size = np.frombuffer(data, dtype=np.int32, count=2, offset=position + 8)
+            quantum = np.frombuffer(data, dtype=np.float64, count=1, offset=position + 16)[0]
+            position += 24
+            snapshot[name] = decode_variable(data[position:position + size], n, coding, quantum)
+            position += size
+        snapshots.append(snapshot)
+    return snapshots
+
+
+if __name__ == "__main__":
+    import os
+    filename = sys.argv[1] if len(sys.argv) > 1 else '../output/snapshots.bin'
+    snapshots = read_snapshots(filename)
+    for s in snapshots:
+        print("output %d\tstep %d\tt = %f\tmax|rho| = %e\tmax|E_x| = %e"
+              % (s['output'], s['step'], s['time'], np.abs(s['rho']).max(), np.abs(s['E_x']).max()))
+    if snapshots:
+        raw = len(snapshots)*6*8*len(snapshots[0]['rho'])
+        print("%d snapshots: %d bytes, %d raw (%.1f times smaller)"
+              % (len(snapshots), os.path.getsize(filename), raw, raw/os.path.getsize(filename)))
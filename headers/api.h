@@ -0,0 +1,34 @@
+/*** Header files for functions in api.c (library interface) ***/
+
+struct simulation * picCreate(char *inputFile, char *lines, char *outputPrefix);
+void picDestroy(struct simulation *s);
+void picPrintParameters(struct simulation *s);
+
+int picStep(struct simulation *s, int nSteps);
+int picDeposit(struct simulation *s);
+int picSolveField(struct simulation *s);
+int picPush(struct simulation *s);
+void picWriteOutput(struct simulation *s, int output);
+
+int picStepNumber(struct simulation *s);
+double picTime(struct simulation *s);
+double picDt(struct simulation *s);
+double picDx(struct simulation *s);
+int picGridPoints(struct simulation *s);
+
+double * picRho(struct simulation *s);
+double * picPotential(struct simulation *s);
+double * picIonDensity(struct simulation *s);
+double * picElectronDensity(struct simulation *s);
+double * picE(struct simulation *s);
+double * picJ(struct simulation *s);
+double * picBz(struct simulation *s);
+
+long picNumberOfIons(struct simulation *s);
+long picNumberOfElectrons(struct simulation *s);
+struct particle * picIons(struct simulation *s);
+struct particle * picElectrons(struct simulation *s);
+
+int picParticleSize();
+int picMixedPrecision();
+void picEnergy(struct simulation *s, double *e);
@@ -0,0 +1,3 @@
+/*** Header files for functions in autotune.c ***/
+
+struct parameters autotuneParameters(struct parameters param, char *prefix);
@@ -0,0 +1,7 @@
+/*** Header files for functions in boundary.c ***/
+
+struct openBoundary * allocateOpenBoundary(struct simulation *s);
+void resizeOpenBoundary(struct openBoundary *ob, long ionsCapacity, long electronsCapacity);
+struct simulation * applyOpenBoundaries(struct simulation *s);
+struct vector2D * openBoundaryField(struct vector2D *E, double *u, int size, double dx);
+void deAllocateOpenBoundary(struct openBoundary *ob);
@@ -0,0 +1,5 @@
+/*** Header files for functions in cadence.c ***/
+
+struct outputCadence * allocateCadence(struct parameters param);
+int outputDue(struct outputCadence *c, struct vector2D *E, int n, struct parameters param);
+void deAllocateCadence(struct outputCadence *c);
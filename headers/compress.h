@@ -0,0 +1,6 @@
+/*** Header files for functions in compress.c ***/
+
+struct snapshotWriter * openSnapshots(struct parameters param, double dx, char *prefix);
+void writeSnapshot(struct simulation *s, int output);
+int snapshotsWaiting(struct snapshotWriter *sw);
+void closeSnapshots(struct snapshotWriter *sw);
@@ -0,0 +1,11 @@
+/*** Header files for functions in domain.c ***/
+
+struct domain * allocateDomains(struct parameters param, double *Bz);
+void deAllocateDomains(struct domain *dom, int nDomains);
+
+struct domain * distributeParticles(struct domain *dom, struct particle *ions, struct particle *electrons,
+                                    struct parameters param, double dx);
+
+void decomposedStep(struct domain *dom, struct phaseSpace *ph, double *Bz,
+                    struct parameters param, double dx);
+void collectDomains(struct domain *dom, int nDomains, struct grid *g, struct field *f, int nGridPoints);
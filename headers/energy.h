@@ -0,0 +1,5 @@
+/*** Header files for functions in energy.c ***/
+
+double kineticEnergy(struct particle *p, long number, double mass, int deltaF);
+double fieldEnergy(struct vector2D *E, int nGridPoints, double dx);
+struct energy simulationEnergy(struct simulation *s);
@@ -0,0 +1,3 @@
+/*** Header files for functions in ensemble.c ***/
+
+double runEnsemble(struct parameters *members, int nMembers);
@@ -0,0 +1,8 @@
+/*** Header files for functions in implicit.c ***/
+
+struct implicitState * allocateImplicit(struct particle *ions, struct particle *electrons,
+                                        struct parameters param);
+void deAllocateImplicit(struct implicitState *im);
+
+int implicitStep(struct implicitState *im, struct particle *ions, struct particle *electrons,
+                 struct grid *g, struct field *f, struct parameters param, double dx);
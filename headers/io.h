@@ -1,6 +1,12 @@
 void printParameters (struct parameters param, int totalTimeSteps, double dx);
 
+struct parameters defaultParameters();
+struct parameters parseParameterLine(struct parameters p, char *buf);
 struct parameters getParametersFromFile(char *filename);
+struct parameters * getEnsembleFromFile(char * filename, struct parameters base, int *nMembers);
+int writeAll(int fd, const void *data, size_t n);
 
-void writeGridOutput(struct grid *g, int nGridPoints, double t);
-void writeFieldOutput(struct field *f, int nGridPoints, double t);
+void writeGridOutput(struct grid *g, int nGridPoints, double t, char *prefix);
+void writeFieldOutput(struct field *f, int nGridPoints, double t, char *prefix);
+void writeEnergyOutput(struct energy e, double t, double time, char *prefix);
+void writeTimesOutput(int output, int step, double time, char *prefix);
@@ -1,6 +1,26 @@
 /*** Header files for functions in memory.c ***/
 
-struct particle *allocateParticles(int number);
+/* Memory policies (see setMemoryPolicy) */
+#define MEMORY_DEFAULT 0
+#define MEMORY_FIRST_TOUCH 1
+#define MEMORY_HUGE_PAGES 2
+#define MEMORY_EXPLICIT_HUGE_PAGES 3
+
+void setMemoryPolicy(int policy);
+int getMemoryPolicy();
+
+void *allocateArray(size_t size);
+void deAllocateArray(void *p);
+void *reallocateArray(void *p, size_t size);
+
+struct particle *allocateParticles(long number);
+void deAllocateParticles(struct particle *p);
+struct particle *mapParticles(long number, char *filename);
+void unmapParticles(struct particle *p, long number);
+
+struct particleBuffer allocateParticleBuffer(long capacity);
+struct particleBuffer appendParticle(struct particleBuffer b, struct particle p);
+void deAllocateParticleBuffer(struct particleBuffer b);
 
 struct grid *allocateGrid(int numberGridPoints);
 void deAllocateGrid(struct grid *g);
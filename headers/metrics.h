@@ -0,0 +1,6 @@
+/*** Header files for functions in metrics.c ***/
+
+struct metricsServer * openMetrics(char *path, struct simulation *s);
+void updateMetrics(struct metricsServer *m, struct simulation *s);
+void updateEnergyMetrics(struct metricsServer *m, struct energy e, int step);
+void closeMetrics(struct metricsServer *m);
@@ -1,3 +1,13 @@
 struct particle moveParticle(struct particle p, double charge, double mass, 
 			     struct field *f, 
 			     double dx, double dt);
+struct particle moveParticleDeltaF(struct particle p, double charge, double mass, double vth2,
+			     struct field *f, 
+			     double dx, double h);
+
+struct particle moveIon(struct particle p, struct field *f, double dx, double dt);
+struct particle moveElectron(struct particle p, struct field *f, double dx, double dt);
+struct particle moveParticleBoris(struct particle p, double charge, double mass,
+			     struct field *f, double dx, double h);
+struct particle startBoris(struct particle p, double charge, double mass,
+                           struct field *f, double dx, double h);
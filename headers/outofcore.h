@@ -0,0 +1,7 @@
+/*** Header files for functions in outofcore.c ***/
+
+void outOfCoreStart(struct particle *ions, struct particle *electrons, struct grid *g, struct field *f,
+                    struct depositBuffers *b, struct poissonStats *stats, struct parameters param, double dx);
+void outOfCoreStep(struct particle *ions, struct particle *electrons, struct grid *g, struct field *f,
+                   struct depositBuffers *b, struct poissonStats *stats, struct parameters param, double dx);
+void finishDensities(double *n, struct vector2D *j, int nGrid, int open, double dx);
@@ -0,0 +1,30 @@
+/*** Header files for functions in phasespace.c ***/
+
+struct phaseSpace * allocatePhaseSpace(struct parameters param);
+void deAllocatePhaseSpace(struct phaseSpace *ph);
+void armPhaseSpace(struct phaseSpace *ph);
+void finishPhaseSpace(struct phaseSpace *ph, int step);
+void phaseSpaceSweep(struct simulation *s);
+
+/* Private histogram of one species (0: ions, 1: electrons) in slot
+   "slot", or NULL when the phase space is off or not armed.
+   Deposition loops call this once, then addToPhaseSpace per particle. */
+static inline double * phaseSpaceBins(struct phaseSpace *ph, int slot, int species)
+{
+  if (ph == NULL || !ph->armed) return NULL;
+  return ph->bins + ((size_t)slot*2 + species)*ph->nx*ph->nv;
+}
+
+/* Adds weight w of a particle at (x, vx) to histogram h
+   (particles outside the v_x range are not counted) */
+static inline void addToPhaseSpace(double *h, struct phaseSpace *ph, int species,
+                                   double x, double vx, double w)
+{
+  int i = (int)((x - ph->xMin)/ph->length*ph->nx);
+  double v = (vx + ph->vMax[species])/(2*ph->vMax[species])*ph->nv;
+
+  if (v < 0 || v >= ph->nv) return;
+  if (i < 0) i = 0;
+  if (i >= ph->nx) i = ph->nx - 1;
+  h[i*ph->nv + (int)v] += w;
+}
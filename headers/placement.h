@@ -0,0 +1,4 @@
+/*** Header files for functions in placement.c ***/
+
+void reportPlacement(char *name, void *p, size_t size);
+void reportSimulationPlacement(struct simulation *s);
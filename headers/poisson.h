@@ -1 +1 @@
-double * poisson1D (double *u, double *rho, int size, double h);
+double * poisson1D (double *u, double *rho, int size, double h, struct poissonStats *stats);
@@ -0,0 +1,6 @@
+/*** Header files for functions in probes.c ***/
+
+struct probeBuffer * openProbes(struct parameters param, double dt, char *prefix);
+void sampleProbes(struct simulation *s);
+void flushProbes(struct probeBuffer *pb);
+void closeProbes(struct probeBuffer *pb);
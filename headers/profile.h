@@ -0,0 +1,23 @@
+/*** Header files for functions in profile.c ***/
+
+/* Profiled phases (see profileStart). The explicit step deposits
+   rho and J together (PROFILE_RHO); PROFILE_J is fromParticlesToGrid's. */
+#define PROFILE_RHO 0
+#define PROFILE_POISSON 1
+#define PROFILE_J 2
+#define PROFILE_FIELD 3
+#define PROFILE_PUSH 4
+#define PROFILE_STEP 5
+#define N_PROFILE_PHASES 6
+
+struct profile * allocateProfile();
+void startProfiling(struct profile *p, struct parameters param);
+int profilingOn(struct profile *p);
+const char * profilePhaseName(int phase);
+double profilePhaseTime(struct profile *p, int phase);
+void profileStart(struct profile *p, int phase);
+void profileStop(struct profile *p, int phase, double items);
+void printProfileReport(struct profile *prof, double peak, double bandwidth);
+void stopProfiling(struct profile *p);
+void startPhaseTiming(struct profile *p);
+void stopPhaseTiming(struct profile *p);
@@ -0,0 +1,5 @@
+/*** Header files for functions in resample.c ***/
+
+void sortByCell(struct particle *p, struct particle *sorted, long n, int nCells, double dx);
+struct particleBuffer resampleSpecies(struct particleBuffer b, long target, int firstCell, int lastCell,
+                                      double dx);
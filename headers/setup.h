@@ -1,4 +1,5 @@
-struct particle checkPeriodic (struct particle p, double left_bound, double right_bound);
+struct particle setParticleX (struct particle p, double x, double dx);
+struct particle checkPeriodic (struct particle p, double left_bound, double right_bound, double dx);
 
 double * applyBoundaryConditions1D (double *a, int size, double leftBound, double rightBound);
 double * setBz (double *Bz, int size);
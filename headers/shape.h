@@ -0,0 +1,168 @@
+/***************************************************************************
+ *** Particle shape (weighting) functions, selected at compile time:
+ ***   SHAPE_ORDER 0: NGP (Nearest Grid Point),  1 point
+ ***   SHAPE_ORDER 1: CIC (Cloud In Cell),       2 points (default)
+ ***   SHAPE_ORDER 2: TSC (Triangular Shaped Cloud), 3 points
+ *** e.g. "make SHAPE_ORDER=2" (after "make clean").
+ *** See Birdsall - Langdon, Part 1, ch.8.
+ ***
+ *** The functions below are static inline (and so live in this header),
+ *** so that every kernel using them is compiled for one shape only, with
+ *** the loops over the SHAPE_POINTS points fully unrolled.
+ ***************************************************************************/
+
+#ifndef SHAPE_ORDER
+#define SHAPE_ORDER 1
+#endif
+
+#define SHAPE_POINTS (SHAPE_ORDER + 1)
+
+/* Returns index of the first grid point the particle at x (in cell "cell")
+   is weighted to, and the SHAPE_POINTS weights in w.
+   Weights are multiplied by dx (they add up to dx): dividing by dx
+   afterwards keeps the CIC results identical to the original formulas.
+   The index may lie outside 0...nGridPoints-1 (see wrapPoint,
+   boundaryPoint).
+ */
+static inline int shapeWeights(double x, int cell, double dx, double *w)
+{
+#if SHAPE_ORDER == 0
+  /* NGP: all weight to nearest point */
+  w[0] = dx;
+  return (x - cell*dx < 0.5*dx) ? cell : cell + 1;
+
+#elif SHAPE_ORDER == 1
+  /* CIC: linear weighting to both ends of the cell */
+  w[0] = (cell+1)*dx - x;
+  w[1] = x - cell*dx;
+  return cell;
+
+#elif SHAPE_ORDER == 2
+  /* TSC: quadratic weighting to nearest point j and its neighbours */
+  double f = (x - cell*dx)/dx;
+  int j = cell;
+
+  if (f >= 0.5) {
+    f -= 1.0;
+    j += 1;
+  }
+  w[0] = 0.5*(0.5 - f)*(0.5 - f)*dx;
+  w[1] = (0.75 - f*f)*dx;
+  w[2] = 0.5*(0.5 + f)*(0.5 + f)*dx;
+  return j - 1;
+
+#else
+#error "SHAPE_ORDER must be 0 (NGP), 1 (CIC) or 2 (TSC)"
+#endif
+}
+
+/* Maps a point index of the periodic grid back into 0...nGridPoints-1.
+   Point nGridPoints-1 is the periodic image of point 0, and is kept
+   as such (deposition folds it back onto point 0).
+ */
+static inline int wrapPoint(int i, int nGridPoints)
+{
+  int nCells = nGridPoints - 1;
+
+  i = (i < 0) ? i + nCells : i;
+  i = (i > nCells) ? i - nCells : i;
+
+  return i;
+}
+
+/* Maps a point index onto the grid: periodic (see wrapPoint), or,
+   between open walls (open = 1), onto the nearest wall for points
+   beyond it (only TSC reaches one point past a wall).
+ */
+static inline int boundaryPoint(int i, int nGridPoints, int open)
+{
+  if (!open) return wrapPoint(i, nGridPoints);
+
+  return i < 0 ? 0 : (i > nGridPoints - 1 ? nGridPoints - 1 : i);
+}
+
+/****************************************************************
+  From grid to particles (gather)
+ ****************************************************************/
+
+/* Maps a point index onto the field arrays of f: the whole grid (see
+   boundaryPoint), or a domain slice (see domain.c), where points are
+   not wrapped. A particle that moved farther than the guard points of
+   its slice in one step sees the field of the outermost one.
+ */
+static inline int fieldPoint(int i, struct field *f)
+{
+  if (!f->slice) return boundaryPoint(i, f->nGridPoints, f->open);
+  i -= f->firstPoint;
+  return i < 0 ? 0 : (i > f->nGridPoints - 1 ? f->nGridPoints - 1 : i);
+}
+
+/* Function that returns the electric field of f
+   at given particle's position x (see fieldPoint).
+*/
+static inline struct vector2D particleE (double x, struct field *f, double dx)
+{
+  int k, first, i;
+  double w[SHAPE_POINTS];
+  struct vector2D pE;
+
+  /* Find weights of neighboring points */
+  first = shapeWeights(x, (int)floor(x/dx), dx, w);
+
+  /* Interpolate fields from neighboring points */
+  pE.x = 0;
+  pE.y = 0;
+  for (k=0; k<SHAPE_POINTS; k++) {
+    i = fieldPoint(first + k, f);
+    pE.x += w[k] * f->E[i].x / dx;
+    pE.y += w[k] * f->E[i].y / dx;
+  }
+
+  return pE;
+}
+
+/* Function that returns the magnetic field Bz of f
+   at given particle's position x (see fieldPoint).
+*/
+static inline double particleBz (double x, struct field *f, double dx)
+{
+  int k, first, i;
+  double w[SHAPE_POINTS];
+  double pB;
+
+  /* Find weights of neighboring points */
+  first = shapeWeights(x, (int)floor(x/dx), dx, w);
+
+  /* Interpolate fields from neighboring points */
+  pB = 0;
+  for (k=0; k<SHAPE_POINTS; k++) {
+    i = fieldPoint(first + k, f);
+    pB += w[k] * f->Bz[i] / dx;
+  }
+
+  return pB;
+}
+
+/* Returns force on given particle.
+   Arguments were chosen to satisfy the Runge-Kutta method,
+   which relies on incrementing position and velocities on each stage.
+*/
+static inline struct vector2D particleF(double x, double v_x, double v_y, double particleCharge,
+                                        struct field *f, double dx)
+{
+  struct vector2D pE, F;
+  double pBz;
+
+  /* Interpolate fields to particle */
+  pE = particleE(x, f, dx);
+  pBz = particleBz(x, f, dx);
+
+  /* Calculate force on particle: F = q * [E + (v x B) ]
+     The cross product in this 1D version was implemented by hand
+     (see the signs).
+  */
+  F.x = particleCharge*(pE.x + v_y*pBz);
+  F.y = particleCharge*(pE.y - v_x*pBz);
+
+  return F;
+}
@@ -0,0 +1,11 @@
+/*** Header files for functions in simulation.c ***/
+
+struct simulation * setupSimulation(struct parameters param, char *outputPrefix);
+struct simulation * pushParticles(struct simulation *s);
+struct simulation * depositParticles(struct simulation *s);
+struct simulation * sortSimulation(struct simulation *s);
+struct simulation * stepSimulation(struct simulation *s);
+struct simulation * collectGrid(struct simulation *s);
+void writeSimulationOutput(struct simulation *s, int output);
+double runSimulation(struct simulation *s);
+void deAllocateSimulation(struct simulation *s);
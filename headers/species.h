@@ -0,0 +1,11 @@
+/*** Header files for functions in species.c ***/
+
+int speciesTable(struct simulation *s, struct speciesEntry *table);
+struct parameters checkSpecies(struct parameters param);
+struct simulation * allocateSpecies(struct simulation *s);
+void pushAllSpecies(struct speciesEntry *table, int nSpecies, struct field *f,
+                    struct parameters param, double dx, int step, int open);
+void depositAllSpecies(struct speciesEntry *table, int nSpecies, struct depositBuffers *b,
+                       struct grid *g, struct parameters param, double dx);
+double speciesEnergy(struct simulation *s);
+void deAllocateSpecies(struct simulation *s);
@@ -0,0 +1,7 @@
+/*** Header files for functions in stream.c ***/
+
+struct parameters checkStreamVariables(struct parameters param);
+struct outputStream * openStream(char *target);
+void connectStream(struct outputStream *st, char *target);
+void streamSimulationOutput(struct simulation *s, int output);
+void closeStream(struct outputStream *st);
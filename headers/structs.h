@@ -8,29 +8,118 @@ struct vector2D {
   double y;
 };
 
-/* Particle structure */
+/* Particle structure 
+   w is the particle weight: 1 for ordinary (full-f) particles,
+   and the perturbation weight delta_f/f_0 in delta-f mode.
+ */
+#ifndef MIXED_PRECISION
 struct particle {
   struct vector2D r;
   struct vector2D v;
+  double w;
+};
+
+/* Position x and cell index of particle */
+#define PARTICLE_X(p, dx) ((p).r.x)
+#define PARTICLE_CELL(p, dx) ((int)floor((p).r.x/(dx)))
+
+#else
+/* Mixed precision particle (compile with -DMIXED_PRECISION):
+   Position is stored as cell index plus offset inside the cell
+   (0 <= offset < 1, in units of dx), so a float offset keeps the same
+   accuracy on any grid size. Velocities and weight are float. There is no y
+   position (the model is 1D in space). Grid quantities, the field
+   solve and the particle push itself stay in double.
+ */
+struct floatVector2D {
+  float x;
+  float y;
+};
+
+struct particle {
+  int cell;
+  float offset;
+  struct floatVector2D v;
+  float w;
+};
+
+#define PARTICLE_X(p, dx) (((p).cell + (double)(p).offset)*(dx))
+#define PARTICLE_CELL(p, dx) ((p).cell)
+#endif
+
+/* phaseSpace structure: Histograms f(x, v_x) of ions (species 0) and
+   electrons (species 1), nx by nv bins, v_x in [-vMax, vMax] (see phasespace.c).
+   Filled by the deposition when armed, into nSlots private copies
+   (one per thread or domain), then added up into f.
+ */
+struct phaseSpace {
+  int every, nx, nv, nSlots;
+  double xMin, length, vMax[2];
+  double *bins, *f;
+  int armed, ready, step;
 };
 
 /* grid structure: Holds all quantities that are interpolated
                 from the particles to the grid.
+   phase is NULL unless phase space histograms are on.
 */
 struct grid {
   double *u;
   double *n_i, *n_e, *rho;
   struct vector2D *J_i, *J_e, *J;
+  struct phaseSpace *phase;
 };
 
 /* field structure: Holds electromagnetic field.
    EM Field is found from grid quantities
    Current program (1d2v): 
    E is 2D (x,y), B is 1D (z)
+   A domain slice (slice = 1, see domain.c) holds grid points
+   firstPoint ... firstPoint+nGridPoints-1 only, guard points
+   included, which are never wrapped.
  */
 struct field {
   struct vector2D *E;
   double *Bz;
+  int nGridPoints, open;
+  int slice, firstPoint;
+};
+
+/* Maximum length of file names (and output prefixes) */
+#define PATH_LENGTH 256
+
+/* streamVariable structure: One grid variable of the streaming output
+   (see stream.c), sent every "every" outputs, with every "stride"-th
+   grid point (bins = 0) or averaged over bins of "stride" points (bins = 1).
+ */
+struct streamVariable {
+  char name[8];
+  int every, stride, bins;
+};
+
+/* Number of grid variables that can be streamed (rho, u, n_i, n_e, E_x, E_y, J_x, J_y, Bz) */
+#define MAX_STREAM_VARIABLES 9
+
+/* Maximum number of probe points (see probes.c) */
+#define MAX_PROBES 32
+
+/* Maximum number of additional particle species (see species.c) */
+#define MAX_SPECIES 8
+
+/* Number of field monitors of the adaptive output (see cadence.c) */
+#define CADENCE_MONITORS 3
+
+/* species structure: An additional particle species (a beam, an
+   impurity), from a 'K' line of the input file: name, number of
+   particles, charge, mass and weight of every particle, temperature
+   and drift velocity (along x) at the start, pusher (0: RK4, 1: Boris)
+   and subcycle (pushed every "subcycle" steps, with subcycle*dt).
+ */
+struct species {
+  char name[8];
+  long number;
+  double charge, mass, weight, T, drift;
+  int pusher, subcycle;
 };
 
 /* parameters structure: Holds everything read from input file 
@@ -41,12 +130,255 @@ struct parameters {
   double time, dt; 
   int interval;
 
-  int nIons, nElectrons;
+  /* Particle counts are long (and so every index into the particle
+     arrays): a species may hold more than 2^31 particles */
+  long nIons, nElectrons;
 
   int nGridPoints;
   double gridStart, gridEnd;
 
   double T_i, T_e, k;
+
+  int nDomains;
+
+  int deltaF;
+
+  int implicit;
+  double implicitTolerance;
+
+  int resampleInterval, resampleTarget;
+
+  int outOfCore, chunkSize;
+
+  int memoryPolicy, memoryReport;
+
+  /* Additional particle species (beside ions and electrons) */
+  int nSpecies;
+  struct species species[MAX_SPECIES];
+
+  /* Quiet start: on/off, mirrored (+v, -v) velocity pairs */
+  int quietStart, quietMirror;
+
+  /* Streaming output: FIFO path or "unix:<socket path>" ("" : off),
+     text output on/off, and the variables to stream */
+  char streamTarget[PATH_LENGTH];
+  int textOutput;
+  int nStreamVariables;
+  struct streamVariable streamVariables[MAX_STREAM_VARIABLES];
+
+  /* Phase space histograms: every "every" outputs (0: off),
+     nx by nv bins, v_x range of ions and electrons */
+  int phaseEvery, phaseNx, phaseNv;
+  double phaseVMax_i, phaseVMax_e;
+
+  /* Probes: grid points sampled every step, and samples per block written */
+  int nProbes, probePoints[MAX_PROBES], probeBlock;
+
+  /* Particle boundaries: 0 periodic, 1 open (absorbing walls),
+     injection from the reservoirs on/off, and their drift velocities */
+  int openBoundaries, injection;
+  double driftIons, driftElectrons;
+
+  /* Tuning: autotuner (0 off, 1 on with cache, 2 on, cache refreshed)
+     and its timed steps per trial, OpenMP threads (0: default),
+     particle sort by cell every sortInterval steps (0: off) */
+  int autotune, tuneSteps, nThreads, sortInterval;
+
+  /* Compressed snapshots: 0 off, 1 lossless, 2 error-bounded
+     (absolute tolerance) */
+  int snapshotMode;
+  double snapshotTolerance;
+
+  /* Adaptive output: on/off, smallest and largest interval (steps)
+     between outputs, and change of the monitors that makes one due */
+  int adaptiveOutput, minInterval, maxInterval;
+  double outputThreshold;
+
+  /* Live metrics: Unix socket path ("" : off) */
+  char metricsPath[PATH_LENGTH];
+
+  /* Profiling: on/off, peak GFLOP/s and bandwidth GB/s (0: measured) */
+  int profile;
+  double profilePeak, profileBandwidth;
 };
 
+/* particleBuffer structure: Growable array of particles.
+   n particles are in use, out of capacity allocated.
+ */
+struct particleBuffer {
+  struct particle *p;
+  long n, capacity;
+};
 
+/* domain structure: Holds one contiguous x-range of the grid 
+   (cells firstCell <= cell < lastCell) and the particles inside it.
+   Used by the domain-decomposed mode, one domain per thread.
+   The grid of a domain is a slice of its own: the points it owns
+   and nGuards guard points on either side, which belong to the
+   neighbours (index 0 is grid point firstCell-nGuards). nGuards
+   follows the farthest a particle moves in one step (see domain.c).
+ */
+struct domain {
+  int firstCell, lastCell;
+
+  struct particleBuffer ions, electrons;
+
+  /* Outgoing particles, to the left and right neighbour, and those
+     received that passed the domain (on their way further) */
+  struct particleBuffer ionsLeft, ionsRight;
+  struct particleBuffer electronsLeft, electronsRight;
+  struct particleBuffer ionsPassLeft, ionsPassRight;
+  struct particleBuffer electronsPassLeft, electronsPassRight;
+
+  /* Grid slice (nLocal points), and its field for the push */
+  int nLocal, nGuards;
+  double *n_i, *n_e, *rho, *u;
+  struct vector2D *J_i, *J_e, *J;
+  struct field f;
+
+  /* Fastest particle (|v_x|) after the last push, and squared
+     residual of the last Poisson check over the owned points */
+  double maxSpeed, residual;
+};
+
+/* implicitState structure: Work arrays of the implicit time step
+   (see implicit.c): particles at the half step, and the field at the
+   start of the step and at the half step.
+ */
+struct implicitState {
+  struct particle *ionsHalf, *electronsHalf;
+  struct vector2D *E_old, *E_half;
+  int nIterations;
+};
+
+/* outputStream structure: Connection of the streaming output (see stream.c).
+   fd is -1 while no viewer is connected; frames are built in buffer.
+ */
+struct outputStream {
+  int fd, socket;
+  int nFrames, nDropped;
+  char *buffer;
+  long capacity;
+};
+
+/* probeBuffer structure: Samples of the probes (see probes.c),
+   nSamples of blockSize records of 1 + 3*nProbes values, written to
+   file descriptor fd as one block when full.
+ */
+struct probeBuffer {
+  int fd, failed;
+  double *samples;
+  int nSamples, blockSize, recordSize;
+  long nWritten;
+};
+
+/* snapshotWriter structure: Compressed snapshot file and its writer
+   thread; defined in compress.c only (holds pthread types).
+ */
+struct snapshotWriter;
+
+/* metricsServer structure: Live metrics socket, its server thread and
+   the published values; defined in metrics.c only (see there).
+ */
+struct metricsServer;
+
+/* openBoundary structure: State of the open particle boundaries
+   (see boundary.c): spare arrays of the same capacity as the particle
+   arrays (the compaction packs into them), particles still due at
+   each wall, reservoir densities, and particles kept per thread.
+ */
+struct openBoundary {
+  long ionsCapacity, electronsCapacity;
+  struct particle *ionsSpare, *electronsSpare;
+  double ionsDue[2], electronsDue[2];
+  double ionDensity, electronDensity;
+  long *counts;
+  unsigned int seed;
+  long nLost, nInjected;
+};
+
+/* speciesEntry structure: One entry of the species table of a run
+   (see species.c): the particles of a species, their kernel, subcycle,
+   charge, mass and delta-f vth^2, and where their density and current go.
+ */
+struct speciesEntry {
+  struct particle *p;
+  long n;
+  int kernel, subcycle;
+  double charge, mass, vth2;
+  double *density;
+  struct vector2D *current;
+};
+
+/* depositBuffers structure: Private density and current arrays of the
+   deposition (see species.c), one block of all species per thread,
+   allocated once for "threads" threads ("used" by the last deposit).
+ */
+struct depositBuffers {
+  int threads, used;
+  double *density;
+  struct vector2D *current;
+};
+
+/* outputCadence structure: State of the adaptive output (see cadence.c):
+   squared monitors of the field over the last "window" steps (a ring,
+   "next" the oldest), their sums, their envelopes at the last output,
+   the steps since then, and the cos, sin tables of the monitored mode.
+ */
+struct outputCadence {
+  double *history;
+  double sum[CADENCE_MONITORS], atOutput[CADENCE_MONITORS];
+  int window, filled, next, sinceOutput;
+  double *modeCos, *modeSin;
+};
+
+/* energy structure: Kinetic energy of each species (others: all
+   additional species together) and field energy */
+struct energy {
+  double ions, electrons, others, field;
+};
+
+/* Poisson statistics of one run: total Gauss-Seidel sweeps of
+   poisson1D (work count for profiling) and residual of the last
+   solve (live metrics) */
+struct poissonStats {
+  long iterations;
+  double residual;
+};
+
+/* simulation structure: Holds the complete state of one run
+   (parameters, particles, grid and field). Several simulations
+   can live in one process (see ensemble.c).
+ */
+struct simulation {
+  struct parameters param;
+  int totalTimeSteps, nOutput, step;
+  double dx;
+
+  struct particle *ions, *electrons;
+  struct grid *g;
+  struct field *f;
+  struct domain *dom;
+  struct implicitState *im;
+  struct outputStream *stream;
+  struct probeBuffer *probes;
+  struct snapshotWriter *snapshots;
+  struct openBoundary *open;
+  struct metricsServer *metrics;
+  struct outputCadence *cadence;
+  struct profile *profile;
+  struct poissonStats poisson;
+
+  /* Additional species (see species.c): particles, density and current;
+     private arrays of the deposition of all species */
+  struct particle *speciesParticles[MAX_SPECIES];
+  double *speciesDensity[MAX_SPECIES];
+  struct vector2D *speciesCurrent[MAX_SPECIES];
+  struct depositBuffers deposit;
+
+  /* Resampling: target number of particles per cell of each species */
+  long ionsTarget, electronsTarget;
+
+  /* Output files are written as <outputPrefix><name>, e.g. output/rho1D.txt */
+  char outputPrefix[PATH_LENGTH];
+};
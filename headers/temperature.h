@@ -1 +1,4 @@
-struct particle *Maxwell_Boltzmann(struct particle *p, double T, int number, double mass);
+struct particle *Maxwell_Boltzmann(struct particle *p, double T, long number, double mass);
+struct particle * quietMaxwell_Boltzmann(struct particle *p, double T, long number, double mass,
+                                         int base, int mirror);
+double deltaF_vth2(struct parameters param, double T, double mass);
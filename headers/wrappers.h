@@ -1,2 +1,3 @@
 struct grid * fromParticlesToGrid(struct grid *g, struct particle *ions, struct particle *electrons, 
-                                             struct parameters param, double dx);
+                                             struct parameters param, double dx,
+                                             struct profile *prof, struct poissonStats *stats);
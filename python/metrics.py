@@ -0,0 +1,56 @@
+### Reads the live metrics of a run (see src/metrics.c).
+### Usage: python metrics.py <socket path>              (run with "L <socket path>")
+###        python metrics.py <socket path> <seconds>    repeats every <seconds>
+### Prints step, rates, time per step of each phase, Poisson solve and energies, one block per read.
+import json
+import socket
+import sys
+import time
+
+
+def read_metrics(path):
+    """Returns the current metrics of the run publishing on socket "path" (a dict)."""
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.connect(path)
+    data = b""
+    while True:
+        chunk = s.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    return json.loads(data.decode())
+
+
+def show(m):
+    print("step %d of %d, t = %g, %.1f s wall" % (m["step"], m["total_steps"], m["time"], m["wall_time"]))
+    print("  %.4g steps/s, %.4g particles/s (%d particles)"
+          % (m["steps_per_second"], m["particles_per_second"], m["particles"]))
+    for name, t in m["phase_seconds_per_step"].items():
+        if t > 0:
+            print("  %-20s %10.4e s per step" % (name, t))
+    print("  Poisson: %d sweeps, residual %.3e" % (m["poisson"]["sweeps"], m["poisson"]["residual"]))
+    e = m["energy"]
+    print("  energy (step %d): ions %.6e electrons %.6e others %.6e field %.6e total %.6e"
+          % (e["step"], e["ions"], e["electrons"], e["others"], e["field"], e["total"]))
+    o = m["output"]
+    print("  snapshots waiting %d, frames sent %d, dropped %d"
+          % (o["snapshots_waiting"], o["frames_sent"], o["frames_dropped"]))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python metrics.py <socket path> [seconds]")
+        sys.exit(1)
+    every = float(sys.argv[2]) if len(sys.argv) > 2 else 0
+    while True:
+        try:
+            show(read_metrics(sys.argv[1]))
+        except (ConnectionRefusedError, FileNotFoundError):
+            print("no run on %s" % sys.argv[1])
+            if not every:
+                sys.exit(1)
+        if not every:
+            break
+        sys.stdout.flush()
+        time.sleep(every)
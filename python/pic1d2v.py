@@ -0,0 +1,196 @@
+### Python binding of the PIC 1d2v library (see src/api.c).
+### Build the library first (in the top directory): make lib
+###
+### Grid and particle arrays are numpy views of the simulation's own
+### memory (no copies): they see every change the simulation makes,
+### and changes made to them go into the simulation.
+### Fetch them again after each step (resampling may move particles).
+###
+### Example (in-process analysis every step):
+###   import pic1d2v
+###   sim = pic1d2v.Simulation("input.txt")
+###   for step in range(100):
+###       sim.step()
+###       print(sim.time, sim.E[:, 0].max(), sim.electrons['v'][:, 0].mean())
+
+import ctypes
+import os
+
+import numpy as np
+
+_here = os.path.dirname(os.path.abspath(__file__))
+_lib = ctypes.CDLL(os.environ.get("PIC1D2V_LIB", os.path.join(_here, "..", "libpic1d2v.so")))
+
+_sim = ctypes.c_void_p
+_double_p = ctypes.POINTER(ctypes.c_double)
+
+### C function signatures
+_lib.picCreate.restype = _sim
+_lib.picCreate.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+_lib.picDestroy.argtypes = [_sim]
+_lib.picPrintParameters.argtypes = [_sim]
+for _name in ["picStepNumber", "picGridPoints", "picDeposit", "picSolveField", "picPush"]:
+    getattr(_lib, _name).restype = ctypes.c_int
+    getattr(_lib, _name).argtypes = [_sim]
+for _name in ["picNumberOfIons", "picNumberOfElectrons"]:
+    getattr(_lib, _name).restype = ctypes.c_long
+    getattr(_lib, _name).argtypes = [_sim]
+_lib.picStep.restype = ctypes.c_int
+_lib.picStep.argtypes = [_sim, ctypes.c_int]
+_lib.picWriteOutput.argtypes = [_sim, ctypes.c_int]
+for _name in ["picTime", "picDt", "picDx"]:
+    getattr(_lib, _name).restype = ctypes.c_double
+    getattr(_lib, _name).argtypes = [_sim]
+for _name in ["picRho", "picPotential", "picIonDensity", "picElectronDensity",
+              "picE", "picJ", "picBz"]:
+    getattr(_lib, _name).restype = _double_p
+    getattr(_lib, _name).argtypes = [_sim]
+for _name in ["picIons", "picElectrons"]:
+    getattr(_lib, _name).restype = ctypes.c_void_p
+    getattr(_lib, _name).argtypes = [_sim]
+_lib.picEnergy.argtypes = [_sim, _double_p]
+
+### Particle layout (struct particle in headers/structs.h)
+if _lib.picMixedPrecision():
+    particle_dtype = np.dtype([('cell', np.int32), ('offset', np.float32),
+                               ('v', np.float32, 2), ('w', np.float32)])
+else:
+    particle_dtype = np.dtype([('r', np.float64, 2), ('v', np.float64, 2), ('w', np.float64)])
+if particle_dtype.itemsize != _lib.picParticleSize():
+    raise ImportError("particle layout of libpic1d2v.so does not match pic1d2v.py")
+
+
+class Simulation:
+    """One simulation, set up from an input file and/or input lines
+    (same format as input.txt, e.g. "T 1.0 0.001 10\\nP 1000 1000")."""
+
+    def __init__(self, input_file=None, lines=None, output_prefix="output/"):
+        self._s = _lib.picCreate(input_file.encode() if input_file else None,
+                                 lines.encode() if lines else None,
+                                 output_prefix.encode())
+        if not self._s:
+            raise ValueError("incomplete parameters (need T, P, S and O lines)")
+
+    def __del__(self):
+        if getattr(self, "_s", None):
+            _lib.picDestroy(self._s)
+            self._s = None
+
+    ### Time stepping
+    def step(self, n=1):
+        """Advances n time steps (any mode)."""
+        return _lib.picStep(self._s, n)
+
+    def deposit(self):
+        """Explicit step, phase 1: particles to grid (rho, J, potential)."""
+        self._check(_lib.picDeposit(self._s))
+
+    def solve_field(self):
+        """Explicit step, phase 2: E from the potential."""
+        self._check(_lib.picSolveField(self._s))
+
+    def push(self):
+        """Explicit step, phase 3: moves the particles (ends the step)."""
+        self._check(_lib.picPush(self._s))
+
+    def write_output(self, output):
+        """Writes the text output files (output 0 creates them)."""
+        _lib.picWriteOutput(self._s, output)
+
+    def print_parameters(self):
+        _lib.picPrintParameters(self._s)
+
+    @staticmethod
+    def _check(status):
+        if status != 0:
+            raise RuntimeError("phase by phase stepping needs the plain explicit mode")
+
+    ### State
+    @property
+    def step_number(self):
+        return _lib.picStepNumber(self._s)
+
+    @property
+    def time(self):
+        return _lib.picTime(self._s)
+
+    @property
+    def dt(self):
+        return _lib.picDt(self._s)
+
+    @property
+    def dx(self):
+        return _lib.picDx(self._s)
+
+    @property
+    def energy(self):
+        """Kinetic energy of ions, electrons, field energy, and kinetic energy
+        of the additional species ("K" lines, all together)."""
+        e = (ctypes.c_double * 4)()
+        _lib.picEnergy(self._s, e)
+        return tuple(e)
+
+    ### Zero-copy views of the grid arrays
+    def _grid(self, function, components=1):
+        n = _lib.picGridPoints(self._s)
+        shape = (n,) if components == 1 else (n, components)
+        return np.ctypeslib.as_array(function(self._s), shape=shape)
+
+    @property
+    def rho(self):
+        return self._grid(_lib.picRho)
+
+    @property
+    def u(self):
+        return self._grid(_lib.picPotential)
+
+    @property
+    def n_i(self):
+        return self._grid(_lib.picIonDensity)
+
+    @property
+    def n_e(self):
+        return self._grid(_lib.picElectronDensity)
+
+    @property
+    def E(self):
+        """E[:, 0] = E_x, E[:, 1] = E_y."""
+        return self._grid(_lib.picE, 2)
+
+    @property
+    def J(self):
+        return self._grid(_lib.picJ, 2)
+
+    @property
+    def Bz(self):
+        return self._grid(_lib.picBz)
+
+    ### Zero-copy views of the particle arrays (structured arrays)
+    def _particles(self, function, number):
+        n = number(self._s)
+        p = function(self._s)
+        if not p:
+            raise RuntimeError("particles live in the domains (domain-decomposed mode)")
+        buffer = (ctypes.c_char * (n*particle_dtype.itemsize)).from_address(p)
+        return np.frombuffer(buffer, dtype=particle_dtype, count=n)
+
+    @property
+    def ions(self):
+        return self._particles(_lib.picIons, _lib.picNumberOfIons)
+
+    @property
+    def electrons(self):
+        return self._particles(_lib.picElectrons, _lib.picNumberOfElectrons)
+
+
+### Demo: run input.txt (of the top directory) and follow the energy in-process
+if __name__ == "__main__":
+    os.chdir(os.path.join(_here, ".."))
+    sim = Simulation("input.txt")
+    sim.print_parameters()
+    for i in range(10):
+        sim.step(10)
+        ions, electrons, field, others = sim.energy
+        print("t = %f\tmax|E_x| = %e\t<v_x> (electrons) = %e\ttotal energy = %e"
+              % (sim.time, np.abs(sim.E[:, 0]).max(), sim.electrons['v'][:, 0].mean(),
+                 ions + electrons + field + others))
@@ -0,0 +1,94 @@
+### Live viewer of the streaming output (see src/stream.c).
+### Usage: python stream_viewer.py <FIFO path>           (run with "W <FIFO path> ...")
+###        python stream_viewer.py unix:<socket path>    (run with "W unix:<socket path> ...")
+###        add "plot" as second argument for a live plot (matplotlib)
+### Start the viewer before or during the run: the run connects at the next output.
+### Phase space histograms ("X" line of input.txt) are plotted as images.
+import socket
+import struct
+import sys
+
+import numpy as np
+
+FRAME_HEADER = struct.Struct("=4siiiddiiii")
+VARIABLE_HEADER = struct.Struct("=8siiii")
+HISTOGRAM_HEADER = struct.Struct("=8siiiidddd")
+
+def readExactly(f, n):
+    data = b""
+    while len(data) < n:
+        chunk = f.read(n - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+def readFrames(f):
+    """Yields frames as dictionaries (time, step, output, dx, variables, histograms),
+    variables as {name: (x, values)} with x in grid coordinates,
+    histograms as {name: (f[nx, nv], (xMin, xMax, vMin, vMax))}."""
+    while True:
+        data = readExactly(f, FRAME_HEADER.size)
+        if data is None:
+            return
+        magic, size, output, step, time, dx, nVariables, nGridPoints, nHistograms, _ = FRAME_HEADER.unpack(data)
+        if magic != b"PICF":
+            raise ValueError("not a frame (stream out of sync)")
+        body = readExactly(f, size - FRAME_HEADER.size)
+        if body is None:
+            return
+        variables, position = {}, 0
+        for i in range(nVariables):
+            name, nPoints, stride, bins, every = VARIABLE_HEADER.unpack_from(body, position)
+            position += VARIABLE_HEADER.size
+            values = np.frombuffer(body, dtype=np.float64, count=nPoints, offset=position)
+            position += 8*nPoints
+            ### Bins: x at the bin centre
+            index = np.arange(nPoints)*stride + (0.5*(stride - 1) if bins else 0)
+            if bins:
+                index[-1] = 0.5*(index[-1] - 0.5*(stride - 1) + nGridPoints - 1)
+            variables[name.rstrip(b"\0").decode()] = (index*dx, values)
+        histograms = {}
+        for i in range(nHistograms):
+            name, nx, nv, _, _, xMin, xMax, vMin, vMax = HISTOGRAM_HEADER.unpack_from(body, position)
+            position += HISTOGRAM_HEADER.size
+            h = np.frombuffer(body, dtype=np.float64, count=nx*nv, offset=position).reshape(nx, nv)
+            position += 8*nx*nv
+            histograms[name.rstrip(b"\0").decode()] = (h, (xMin, xMax, vMin, vMax))
+        yield dict(time=time, step=step, output=output, dx=dx, variables=variables,
+                   histograms=histograms)
+
+def openTarget(target):
+    if target.startswith("unix:"):
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(target[len("unix:"):])
+        server.listen(1)
+        connection, _ = server.accept()
+        return connection.makefile("rb")
+    return open(target, "rb")
+
+if __name__ == "__main__":
+    f = openTarget(sys.argv[1])
+    plot = len(sys.argv) > 2 and sys.argv[2] == "plot"
+    if plot:
+        import matplotlib.pyplot as plt
+        plt.ion()
+    for frame in readFrames(f):
+        print("output %d  step %d  t = %f" % (frame["output"], frame["step"], frame["time"]))
+        for name, (x, values) in frame["variables"].items():
+            print("\t%-4s %5d points  min %+e  max %+e" % (name, len(values), values.min(), values.max()))
+        for name, (f, extent) in frame["histograms"].items():
+            print("\t%-4s %dx%d bins  total weight %e" % (name, f.shape[0], f.shape[1], f.sum()))
+        if plot:
+            plt.clf()
+            n = 1 + len(frame["histograms"])
+            plt.subplot(1, n, 1)
+            for name, (x, values) in frame["variables"].items():
+                plt.plot(x, values, label=name)
+            plt.legend(); plt.grid(True)
+            plt.title("t = %f" % frame["time"])
+            for i, (name, (f, extent)) in enumerate(frame["histograms"].items()):
+                plt.subplot(1, n, i + 2)
+                plt.imshow(f.T, origin="lower", aspect="auto", extent=extent)
+                plt.xlabel("x"); plt.ylabel("v_x"); plt.title(name)
+            plt.pause(0.01)
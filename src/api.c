@@ -0,0 +1,180 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Library API
+ ***
+ *** Flat C interface of the simulation core, for embedding it in
+ *** other programs (built as libpic1d2v.so by "make lib"; see
+ *** python/pic1d2v.py for the Python binding).
+ *** A simulation is created from an input file and/or input lines,
+ *** advanced step by step (or phase by phase: deposit, field, push),
+ *** and its arrays are handed out directly, without copies.
+ *** Array pointers may change when particles are resampled,
+ *** so they should be fetched again after every step.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../headers/structs.h"
+#include "../headers/io.h"
+#include "../headers/simulation.h"
+#include "../headers/wrappers.h"
+#include "../headers/fields.h"
+#include "../headers/energy.h"
+#include "../headers/boundary.h"
+#include "../headers/api.h"
+
+#define LINE_LENGTH 100
+
+/*** Setup / clean up ***/
+
+/* Creates a simulation from input file "inputFile" (may be NULL:
+   defaults only), followed by the input lines in "lines" (may be NULL;
+   same format as the input file, separated by newlines).
+   Output files are written as <outputPrefix><name>.
+   Returns NULL if the parameters are incomplete.
+ */
+struct simulation * picCreate(char *inputFile, char *lines, char *outputPrefix)
+{
+  struct parameters param;
+  char buf[LINE_LENGTH];
+  char *line, *end;
+  size_t length;
+
+  param = (inputFile != NULL) ? getParametersFromFile(inputFile) : defaultParameters();
+
+  for (line = lines; line != NULL && *line != '\0'; line = (*end == '\0') ? end : end + 1) {
+    end = strchr(line, '\n');
+    if (end == NULL) end = line + strlen(line);
+    length = end - line;
+    if (length >= LINE_LENGTH) length = LINE_LENGTH - 1;
+    memcpy(buf, line, length);
+    buf[length] = '\0';
+    param = parseParameterLine(param, buf);
+  }
+
+  if (param.dt <= 0 || param.interval < 1 || param.nGridPoints < 3 ||
+      param.gridEnd <= param.gridStart) return NULL;
+
+  return setupSimulation(param, outputPrefix != NULL ? outputPrefix : "output/");
+}
+
+/* Destroys a simulation */
+void picDestroy(struct simulation *s)
+{
+  deAllocateSimulation(s); free(s);
+}
+
+/* Prints the parameters of a simulation (as the program does) */
+void picPrintParameters(struct simulation *s)
+{
+  printParameters(s->param, s->totalTimeSteps, s->dx);
+}
+
+/*** Time stepping ***/
+
+/* Advances the simulation by nSteps time steps (any mode).
+   Returns number of steps done since setup.
+ */
+int picStep(struct simulation *s, int nSteps)
+{
+  int t;
+
+  for (t=0; t<nSteps; t++) {
+    s = stepSimulation(s);
+  }
+  /* Grid arrays of the last step (see picRho...) */
+  s = collectGrid(s);
+
+  return s->step;
+}
+
+/* Phases of the explicit step, one by one (picDeposit, picSolveField,
+   picPush together are one picStep). Only for the plain explicit mode
+   (no domains, implicit step or out-of-core particles): return -1
+   otherwise, 0 on success.
+ */
+static int explicitMode(struct simulation *s)
+{
+  return s->param.nDomains == 0 && !s->param.implicit && !s->param.outOfCore;
+}
+
+/* Particles to grid (rho, J) and potential u */
+int picDeposit(struct simulation *s)
+{
+  if (!explicitMode(s)) return -1;
+  s = depositParticles(s);
+  return 0;
+}
+
+/* Electric field from the potential */
+int picSolveField(struct simulation *s)
+{
+  if (!explicitMode(s)) return -1;
+  s->f->E = findEx_fromPotential(s->f->E, s->g->u, s->param.nGridPoints, s->dx);
+  if (s->open != NULL) s->f->E = openBoundaryField(s->f->E, s->g->u, s->param.nGridPoints, s->dx);
+  return 0;
+}
+
+/* Moves the particles with the current field (ends the time step) */
+int picPush(struct simulation *s)
+{
+  if (!explicitMode(s)) return -1;
+  s = pushParticles(s);
+  if (s->open != NULL) s = applyOpenBoundaries(s);
+  s->step++;
+  return 0;
+}
+
+/* Writes output number "output" to the text files (0: creates them) */
+void picWriteOutput(struct simulation *s, int output)
+{
+  writeSimulationOutput(s, output);
+}
+
+/*** State ***/
+
+int picStepNumber(struct simulation *s) { return s->step; }
+double picTime(struct simulation *s) { return s->step*s->param.dt; }
+double picDt(struct simulation *s) { return s->param.dt; }
+double picDx(struct simulation *s) { return s->dx; }
+int picGridPoints(struct simulation *s) { return s->param.nGridPoints; }
+
+/* Grid arrays (nGridPoints values; E and J hold x, y pairs) */
+double * picRho(struct simulation *s) { return s->g->rho; }
+double * picPotential(struct simulation *s) { return s->g->u; }
+double * picIonDensity(struct simulation *s) { return s->g->n_i; }
+double * picElectronDensity(struct simulation *s) { return s->g->n_e; }
+double * picE(struct simulation *s) { return (double *)s->f->E; }
+double * picJ(struct simulation *s) { return (double *)s->g->J; }
+double * picBz(struct simulation *s) { return s->f->Bz; }
+
+/* Particle arrays (NULL in the domain-decomposed mode, where
+   particles live in the domains) */
+long picNumberOfIons(struct simulation *s) { return s->param.nIons; }
+long picNumberOfElectrons(struct simulation *s) { return s->param.nElectrons; }
+struct particle * picIons(struct simulation *s) { return s->param.nDomains > 0 ? NULL : s->ions; }
+struct particle * picElectrons(struct simulation *s) { return s->param.nDomains > 0 ? NULL : s->electrons; }
+
+/* Particle layout (see structs.h): size in bytes, and 1 for the
+   mixed precision build */
+int picParticleSize() { return sizeof(struct particle); }
+int picMixedPrecision()
+{
+#ifdef MIXED_PRECISION
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* Kinetic (ions, electrons) and field energy, in e[0], e[1], e[2],
+   and kinetic energy of the additional species (all together) in e[3] */
+void picEnergy(struct simulation *s, double *e)
+{
+  struct energy en = simulationEnergy(s);
+
+  e[0] = en.ions;
+  e[1] = en.electrons;
+  e[2] = en.field;
+  e[3] = en.others;
+}
@@ -0,0 +1,264 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Autotuner
+ ***
+ *** Picks the fastest settings for the problem size and the machine:
+ ***   - number of OpenMP threads,
+ ***   - deposition strategy: one shared grid, or one domain per
+ ***     thread (see domain.c),
+ ***   - particle sort by cell: interval in steps, or off,
+ ***   - chunk size (out-of-core mode).
+ *** Settings are tried one at a time (the others at their best so
+ *** far): every trial sets up the simulation, runs a warm-up step and
+ *** a few timed steps. Particles start sorted by position, so the sort
+ *** trials shuffle them first (the order of a long run without sorts),
+ *** and sort them once before timing if the trial sorts.
+ *** The choice is cached in autotune.cache (in the current directory),
+ *** one line per machine, build and problem size, and later runs of
+ *** the same problem reuse it without trials.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/simulation.h"
+
+#define AUTOTUNE_CACHE "autotune.cache"
+#define KEY_LENGTH 256
+#define LINE_LENGTH 512
+
+/* Tuned settings (decomposed: one domain per thread) */
+struct tuning {
+  int nThreads, decomposed, sortInterval, chunkSize;
+  double stepTime;
+};
+
+/* Cache key: machine (host name, processors), build (shape order,
+   precision) and problem (particles, grid points, time step mode,
+   boundaries, additional species) */
+static void tuningKey(struct parameters param, char *key)
+{
+  char host[64];
+
+  if (gethostname(host, sizeof(host)) != 0) strcpy(host, "unknown");
+  host[sizeof(host) - 1] = '\0';
+
+#ifdef MIXED_PRECISION
+  snprintf(key, KEY_LENGTH, "%s %d shape%d-mixed %ld %ld %d %d %d %d %d %d", host, omp_get_num_procs(),
+#else
+  snprintf(key, KEY_LENGTH, "%s %d shape%d-double %ld %ld %d %d %d %d %d %d", host, omp_get_num_procs(),
+#endif
+           SHAPE_ORDER, param.nIons, param.nElectrons, param.nGridPoints,
+           param.implicit, param.outOfCore, param.deltaF, param.openBoundaries, param.nSpecies);
+}
+
+/* Finds the cached tuning of "key". Returns 0 if there is none. */
+static int readTuning(char *key, struct tuning *t)
+{
+  FILE *file = fopen(AUTOTUNE_CACHE, "r");
+  char buf[LINE_LENGTH];
+  size_t length = strlen(key);
+  int found = 0;
+
+  if (file == NULL) return 0;
+  while (!found && fgets(buf, LINE_LENGTH, file) != NULL) {
+    if (strncmp(buf, key, length) != 0 || buf[length] != ' ') continue;
+    found = (sscanf(buf + length, "%d %d %d %d %lf", &t->nThreads, &t->decomposed,
+                    &t->sortInterval, &t->chunkSize, &t->stepTime) == 5);
+  }
+  fclose(file);
+
+  return found;
+}
+
+/* Stores the tuning of "key" (replacing an older one) */
+static void writeTuning(char *key, struct tuning t)
+{
+  FILE *file = fopen(AUTOTUNE_CACHE, "r");
+  char buf[LINE_LENGTH], *lines = NULL;
+  size_t length = strlen(key), size = 0, n;
+
+  /* Keep the other lines */
+  if (file != NULL) {
+    while (fgets(buf, LINE_LENGTH, file) != NULL) {
+      if (strncmp(buf, key, length) == 0 && buf[length] == ' ') continue;
+      if (buf[0] == '#') continue;
+      n = strlen(buf);
+      lines = (char *)realloc(lines, size + n + 1);
+      memcpy(lines + size, buf, n + 1);
+      size += n;
+    }
+    fclose(file);
+  }
+
+  file = fopen(AUTOTUNE_CACHE, "w");
+  if (file == NULL) {
+    free(lines);
+    return;
+  }
+  fprintf(file, "# pic1d2v autotuner: host processors build nIons nElectrons nGridPoints"
+          " implicit outOfCore deltaF openBoundaries nSpecies -> threads decomposed sort chunk"
+          " step_time\n");
+  if (lines != NULL) fputs(lines, file);
+  fprintf(file, "%s %d %d %d %d %.6e\n", key, t.nThreads, t.decomposed, t.sortInterval,
+          t.chunkSize, t.stepTime);
+  fclose(file);
+  free(lines);
+}
+
+/* Applies tuning t to the parameters */
+static struct parameters applyTuning(struct parameters param, struct tuning t)
+{
+  param.nThreads = t.nThreads;
+  param.nDomains = t.decomposed ? t.nThreads : 0;
+  param.sortInterval = t.sortInterval;
+  param.chunkSize = t.chunkSize;
+
+  return param;
+}
+
+/* Puts the n particles of p in random order (fixed seed) */
+static void shuffleParticles(struct particle *p, long n)
+{
+  unsigned int seed = 101;
+  unsigned long r;
+  struct particle q;
+  long i, j;
+
+  for (i=n-1; i>0; i--) {
+    /* Two draws: rand_r gives only 31 bits */
+    r = (unsigned long)rand_r(&seed) << 31;
+    r += rand_r(&seed);
+    j = r % (i + 1);
+    q = p[i]; p[i] = p[j]; p[j] = q;
+  }
+}
+
+/* Time per step (s) of the simulation with tuning t: mean over
+   nSteps steps after a warm-up step (a mean, so that sorts count).
+   disorder: particles shuffled first (sort trials).
+ */
+static double trialTime(struct parameters param, struct tuning t, int nSteps, char *prefix,
+                        int disorder)
+{
+  struct simulation *s;
+  double time;
+  int i;
+
+  param = applyTuning(param, t);
+  /* Trials write no output */
+  param.streamTarget[0] = '\0';
+  param.phaseEvery = 0;
+  param.nProbes = 0;
+  param.profile = 0;
+  param.memoryReport = 0;
+  param.snapshotMode = 0;
+  param.metricsPath[0] = '\0';
+
+  s = setupSimulation(param, prefix);
+  if (disorder) {
+    /* Domain-decomposed mode: the domains hold the particles */
+    for (i=0; i<s->param.nDomains; i++) {
+      shuffleParticles(s->dom[i].ions.p, s->dom[i].ions.n);
+      shuffleParticles(s->dom[i].electrons.p, s->dom[i].electrons.n);
+    }
+    if (s->param.nDomains == 0) {
+      shuffleParticles(s->ions, s->param.nIons);
+      shuffleParticles(s->electrons, s->param.nElectrons);
+    }
+    /* As if sorted at the end of the sort interval before */
+    if (t.sortInterval > 0) s = sortSimulation(s);
+  }
+  s = stepSimulation(s);
+  time = omp_get_wtime();
+  for (i=0; i<nSteps; i++) s = stepSimulation(s);
+  time = (omp_get_wtime() - time)/nSteps;
+  deAllocateSimulation(s); free(s);
+
+  printf("# Autotuner: %d threads, %s, sort %d, chunk %d: %.3e s per step\n", t.nThreads,
+         t.decomposed ? "domains" : "shared grid", t.sortInterval, t.chunkSize, time);
+
+  return time;
+}
+
+/* Tries tuning t: keeps it in *best if it is faster */
+static void tryTuning(struct parameters param, struct tuning t, int nSteps, char *prefix,
+                      int disorder, struct tuning *best)
+{
+  t.stepTime = trialTime(param, t, nSteps, prefix, disorder);
+  if (t.stepTime < best->stepTime) *best = t;
+}
+
+/* Returns the parameters with the tuned settings: from the cache,
+   or from trials (autotune = 2: always from trials). Trials set up
+   simulations with output prefix "prefix".
+ */
+struct parameters autotuneParameters(struct parameters param, char *prefix)
+{
+  char key[KEY_LENGTH];
+  struct tuning best, t;
+  int k, procs = omp_get_num_procs(), nSteps = param.tuneSteps > 0 ? param.tuneSteps : 5;
+  int sorts[2] = {nSteps, 4*nSteps};
+  /* Decomposed mode is not available with delta-f, implicit, out-of-core,
+     open boundaries or additional species */
+  int canDecompose = !param.deltaF && !param.implicit && !param.outOfCore && !param.openBoundaries &&
+                     param.nSpecies == 0;
+
+  tuningKey(param, key);
+  if (param.autotune == 1 && readTuning(key, &best)) {
+    printf("# Autotuner: cached settings (%s)\n", AUTOTUNE_CACHE);
+    return applyTuning(param, best);
+  }
+
+  /* Start: the given settings */
+  best.nThreads = param.nThreads > 0 ? param.nThreads : omp_get_max_threads();
+  best.decomposed = (param.nDomains > 0 && canDecompose);
+  best.sortInterval = param.sortInterval;
+  best.chunkSize = param.chunkSize;
+  best.stepTime = trialTime(param, best, nSteps, prefix, 0);
+
+  /* Threads: powers of two, and all processors */
+  for (k=1; k<=procs; k = (k < procs && 2*k > procs) ? procs : 2*k) {
+    if (k == best.nThreads) continue;
+    t = best; t.nThreads = k;
+    tryTuning(param, t, nSteps, prefix, 0, &best);
+  }
+
+  /* Deposition strategy */
+  if (canDecompose && best.nThreads > 1) {
+    t = best; t.decomposed = !best.decomposed;
+    tryTuning(param, t, nSteps, prefix, 0, &best);
+  }
+
+  /* Sort interval (plain explicit mode: shared grid, particles in memory),
+     all trials (the best so far again) on shuffled particles */
+  if (!best.decomposed && !param.implicit && !param.outOfCore) {
+    best.stepTime = trialTime(param, best, best.sortInterval > nSteps ? best.sortInterval : nSteps,
+                              prefix, 1);
+    t = best; t.sortInterval = 0;
+    if (best.sortInterval != 0) tryTuning(param, t, nSteps, prefix, 1, &best);
+    for (k=0; k<2; k++) {
+      if (sorts[k] == best.sortInterval) continue;
+      t = best; t.sortInterval = sorts[k];
+      tryTuning(param, t, sorts[k] > nSteps ? sorts[k] : nSteps, prefix, 1, &best);
+    }
+  }
+
+  /* Chunk size (out-of-core mode) */
+  if (param.outOfCore) {
+    for (k=65536; k<=4194304; k*=4) {
+      if (k == best.chunkSize) continue;
+      t = best; t.chunkSize = k;
+      tryTuning(param, t, nSteps, prefix, 0, &best);
+    }
+  }
+
+  writeTuning(key, best);
+  printf("# Autotuner: %d threads, %s, sort %d, chunk %d (saved in %s)\n", best.nThreads,
+         best.decomposed ? "domains" : "shared grid", best.sortInterval, best.chunkSize,
+         AUTOTUNE_CACHE);
+
+  return applyTuning(param, best);
+}
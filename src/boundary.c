@@ -0,0 +1,243 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Open Particle Boundaries
+ ***
+ *** The walls at gridStart and gridEnd absorb the particles that
+ *** reach them, and (optionally) inject new particles from a
+ *** reservoir plasma outside: a Maxwellian of the initial density
+ *** and temperature of each species, drifting along x (a beam when
+ *** the drift is large). The walls are grounded (u = 0, as in
+ *** poisson1D), and E at the walls is one-sided. Deposition and
+ *** gather stop at the walls too: shape points beyond a wall go to
+ *** the wall point (see boundaryPoint), and the two wall points are
+ *** not folded together as the periodic seam (see finishDensities).
+ ***
+ *** After every push, the particles still inside are packed in order
+ *** into a spare array (parallel stream compaction: every thread
+ *** counts its block, and copies it to the offset given by the
+ *** counts of the threads before it), the injected ones are appended,
+ *** and the arrays are swapped. Blocks are those of the static
+ *** schedule of the particle loops, so every thread touches its own
+ *** pages.
+ *** Arrays grow by half (and shrink by half below a quarter full),
+ *** so they are reallocated only rarely.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/memory.h"
+#include "../headers/setup.h"
+#include "../headers/definitions.h"
+
+#define K_B 1.0
+#define MIN_CAPACITY 1024
+
+/* Reservoir of one species, seen from a wall */
+struct reservoir {
+  double density, vth, drift;
+};
+
+/* Random number in (0, 1) from the generator state *seed */
+static double uniformOpen(unsigned int *seed)
+{
+  return (rand_r(seed) + 0.5)/((double)RAND_MAX + 1.0);
+}
+
+/* Particles per unit time crossing a wall inwards, for a reservoir
+   drifting with velocity "drift" along the inward normal:
+   n integral_0^inf v f(v) dv for a drifting Maxwellian f */
+static double inwardFlux(struct reservoir r, double drift)
+{
+  if (r.vth <= 0) return drift > 0 ? r.density*drift : 0;
+
+  return r.density*(r.vth/sqrt(2*M_PI)*exp(-0.5*drift*drift/(r.vth*r.vth)) +
+                    0.5*drift*(1 + erf(drift/(M_SQRT2*r.vth))));
+}
+
+/* Inward speed of an injected particle: sampled from v f(v), v > 0
+   (drifting Gaussian proposals, accepted with probability ~ v) */
+static double inwardSpeed(struct reservoir r, double drift, unsigned int *seed)
+{
+  double v, vMax = fabs(drift) + 6*r.vth;
+
+  if (r.vth <= 0) return drift;
+
+  while (1) {
+    v = drift + r.vth*sqrt(-2*log(uniformOpen(seed)))*cos(2*M_PI*uniformOpen(seed));
+    if (v > 0 && uniformOpen(seed)*vMax < v) return v;
+  }
+}
+
+/* Makes sure the particle and spare arrays hold "needed" particles */
+static void ensureCapacity(struct particle **p, struct particle **spare, long *capacity, long needed)
+{
+  if (needed <= *capacity) return;
+
+  *capacity = (needed > *capacity + *capacity/2) ? needed : *capacity + *capacity/2;
+  *p = (struct particle *)reallocateArray(*p, (size_t)*capacity*sizeof(struct particle));
+  *spare = (struct particle *)reallocateArray(*spare, (size_t)*capacity*sizeof(struct particle));
+}
+
+/* Packs the particles of p[0]...p[n-1] inside [left, right] into
+   out, keeping their order. Returns their number.
+ */
+static long compactParticles(struct particle *p, long n, struct particle *out,
+                             double left, double right, double dx, long *counts)
+{
+  long kept = 0;
+
+  #pragma omp parallel
+  {
+    int t = omp_get_thread_num(), nThreads = omp_get_num_threads(), k;
+    long q = n/nThreads, r = n%nThreads;
+    long first = t*q + (t < r ? t : r), last = first + q + (t < r);
+    long i, offset = 0, count = 0;
+    double x;
+
+    for (i=first; i<last; i++) {
+      x = PARTICLE_X(p[i], dx);
+      count += (x >= left && x <= right);
+    }
+    counts[t] = count;
+    #pragma omp barrier
+
+    for (k=0; k<t; k++) offset += counts[k];
+    for (i=first; i<last; i++) {
+      x = PARTICLE_X(p[i], dx);
+      if (x >= left && x <= right) out[offset++] = p[i];
+    }
+    if (t == nThreads - 1) kept = offset;
+  }
+
+  return kept;
+}
+
+/* Absorbs and injects the particles of one species. p holds n
+   particles; spare (same capacity) receives the result, and the
+   arrays are swapped. due: particles still to inject at each wall.
+   Returns the new number of particles.
+ */
+static long openSpecies(struct openBoundary *ob, struct particle **p, struct particle **spare,
+                        long *capacity, long n, double *due, struct reservoir r,
+                        struct parameters param, double dx)
+{
+  struct particle *out, q;
+  double length = param.gridEnd - param.gridStart, v, x;
+  long nIn[2], kept, i;
+  int wall;
+
+  /* Number to inject at each wall this step (left: drift inwards,
+     right: against it) */
+  for (wall=0; wall<2; wall++) {
+    due[wall] += param.injection ? inwardFlux(r, wall == 0 ? r.drift : -r.drift)*param.dt : 0;
+    nIn[wall] = (long)due[wall];
+    due[wall] -= nIn[wall];
+  }
+  ensureCapacity(p, spare, capacity, n + nIn[0] + nIn[1]);
+
+  kept = compactParticles(*p, n, *spare, param.gridStart, param.gridEnd, dx, ob->counts);
+  ob->nLost += n - kept;
+
+  /* Injected particles: spread over the distance covered in this step */
+  out = *spare;
+  for (wall=0; wall<2; wall++) {
+    for (i=0; i<nIn[wall]; i++) {
+      v = inwardSpeed(r, wall == 0 ? r.drift : -r.drift, &ob->seed);
+      x = v*param.dt*uniformOpen(&ob->seed);
+      if (x > length) x = length;
+      q = out[kept];
+      q = setParticleX(q, wall == 0 ? param.gridStart + x : param.gridEnd - x, dx);
+#ifndef MIXED_PRECISION
+      q.r.y = 0.0;
+#endif
+      q.v.x = wall == 0 ? v : -v;
+      q.v.y = 0.0;
+      q.w = 1.0;
+      out[kept++] = q;
+    }
+    ob->nInjected += nIn[wall];
+  }
+
+  /* Swap, and give back memory of a far emptier domain */
+  *spare = *p;
+  *p = out;
+  if (kept < *capacity/4 && *capacity > MIN_CAPACITY) {
+    *capacity /= 2;
+    *p = (struct particle *)reallocateArray(*p, (size_t)*capacity*sizeof(struct particle));
+    *spare = (struct particle *)reallocateArray(*spare, (size_t)*capacity*sizeof(struct particle));
+  }
+
+  return kept;
+}
+
+/* Allocates the open boundary state (after the particle setup) */
+struct openBoundary * allocateOpenBoundary(struct simulation *s)
+{
+  struct openBoundary *ob = (struct openBoundary *)malloc(sizeof(struct openBoundary));
+
+  ob->ionsCapacity = s->param.nIons;
+  ob->electronsCapacity = s->param.nElectrons;
+  ob->ionsSpare = allocateParticles(ob->ionsCapacity);
+  ob->electronsSpare = allocateParticles(ob->electronsCapacity);
+  ob->ionsDue[0] = ob->ionsDue[1] = 0;
+  ob->electronsDue[0] = ob->electronsDue[1] = 0;
+  ob->counts = (long *)malloc(omp_get_max_threads()*sizeof(long));
+  ob->ionDensity = s->param.nIons/(s->param.gridEnd - s->param.gridStart);
+  ob->electronDensity = s->param.nElectrons/(s->param.gridEnd - s->param.gridStart);
+  ob->seed = 101;
+  ob->nLost = 0;
+  ob->nInjected = 0;
+
+  return ob;
+}
+
+/* Resizes a spare array to the capacity of its particle array
+   (after resampling, which reallocates the particles) */
+void resizeOpenBoundary(struct openBoundary *ob, long ionsCapacity, long electronsCapacity)
+{
+  if (ionsCapacity != ob->ionsCapacity) {
+    ob->ionsCapacity = ionsCapacity;
+    ob->ionsSpare = (struct particle *)reallocateArray(ob->ionsSpare, (size_t)ionsCapacity*sizeof(struct particle));
+  }
+  if (electronsCapacity != ob->electronsCapacity) {
+    ob->electronsCapacity = electronsCapacity;
+    ob->electronsSpare = (struct particle *)reallocateArray(ob->electronsSpare, (size_t)electronsCapacity*sizeof(struct particle));
+  }
+}
+
+/* Removes the particles that left the domain, and injects new ones
+   from the reservoirs at both walls (after the push) */
+struct simulation * applyOpenBoundaries(struct simulation *s)
+{
+  struct openBoundary *ob = s->open;
+  struct reservoir ions = {ob->ionDensity, sqrt(K_B*s->param.T_i/ION_MASS), s->param.driftIons};
+  struct reservoir electrons = {ob->electronDensity, sqrt(K_B*s->param.T_e/ELECTRON_MASS), s->param.driftElectrons};
+
+  s->param.nIons = openSpecies(ob, &s->ions, &ob->ionsSpare, &ob->ionsCapacity, s->param.nIons,
+                               ob->ionsDue, ions, s->param, s->dx);
+  s->param.nElectrons = openSpecies(ob, &s->electrons, &ob->electronsSpare, &ob->electronsCapacity,
+                                    s->param.nElectrons, ob->electronsDue, electrons, s->param, s->dx);
+
+  return s;
+}
+
+/* E_x at the walls: one-sided differences (2nd order) of the
+   potential, instead of the periodic central difference */
+struct vector2D * openBoundaryField(struct vector2D *E, double *u, int size, double dx)
+{
+  E[0].x = - (-3*u[0] + 4*u[1] - u[2])/(2*dx);
+  E[size-1].x = - (3*u[size-1] - 4*u[size-2] + u[size-3])/(2*dx);
+
+  return E;
+}
+
+/* Frees the open boundary state */
+void deAllocateOpenBoundary(struct openBoundary *ob)
+{
+  printf("# Open boundaries: %ld particles absorbed, %ld injected\n", ob->nLost, ob->nInjected);
+  deAllocateParticles(ob->ionsSpare);
+  deAllocateParticles(ob->electronsSpare);
+  free(ob->counts);
+}
@@ -0,0 +1,158 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Adaptive Output Cadence
+ ***
+ *** Instead of every "interval" steps, outputs are written when the
+ *** system has changed enough since the last one. After every step,
+ *** cheap monitors of the field (one pass over the grid) are taken:
+ ***   - field energy (sum of E^2),
+ ***   - max |E_x|,
+ ***   - amplitude of mode k of E_x (k of input.txt).
+ *** The field of a plasma oscillates at the plasma frequency, and
+ *** passes near zero twice per period: the monitors themselves swing
+ *** by orders of magnitude while nothing changes. So their envelope
+ *** is followed instead, the RMS over the last plasma period (a
+ *** sliding window of steps), and an output is due when the envelope
+ *** of any monitor has changed by the threshold (relative, in |E|)
+ *** since the last output: outputs come often while the field grows
+ *** or damps fast, and far apart when the system is steady. Their
+ *** spacing is kept between a smallest and a largest interval.
+ *** Every output is tagged with its step and time in times.txt (and
+ *** in energy.txt, the snapshots and the streaming output), for
+ *** analysis of the non-uniform sampling (see analysis/fourier.py).
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../headers/structs.h"
+#include "../headers/definitions.h"
+
+/* Longest envelope window (steps) */
+#define MAX_WINDOW 65536
+
+/* Steps per plasma period: omega_p^2 = sum of n q^2/(eps_0 m) over
+   all species (densities of the initial, uniform loading) */
+static int plasmaPeriodSteps(struct parameters param)
+{
+  double length = param.gridEnd - param.gridStart, wp2, steps;
+  int k;
+
+  wp2 = param.nIons*ION_CHARGE*ION_CHARGE/ION_MASS +
+        param.nElectrons*ELECTRON_CHARGE*ELECTRON_CHARGE/ELECTRON_MASS;
+  for (k=0; k<param.nSpecies; k++) {
+    struct species sp = param.species[k];
+    wp2 += sp.number*sp.weight*sp.charge*sp.charge/sp.mass;
+  }
+  wp2 /= E_0*length;
+
+  if (wp2 <= 0) return 1;
+  steps = ceil(2*M_PI/(sqrt(wp2)*param.dt));
+
+  return steps > MAX_WINDOW ? MAX_WINDOW : (steps < 1 ? 1 : (int)steps);
+}
+
+/* Allocates the adaptive output state (mode tables of mode k of
+   the grid of param, envelope window of one plasma period; no
+   reference envelope yet: -1) */
+struct outputCadence * allocateCadence(struct parameters param)
+{
+  struct outputCadence *c = (struct outputCadence *)malloc(sizeof(struct outputCadence));
+  int i, m, n = param.nGridPoints - 1;
+  double mode = param.k > 0 ? param.k : 1.0;
+
+  c->modeCos = (double *)malloc(n*sizeof(double));
+  c->modeSin = (double *)malloc(n*sizeof(double));
+  for (i=0; i<n; i++) {
+    c->modeCos[i] = cos(2*M_PI*mode*i/n);
+    c->modeSin[i] = sin(2*M_PI*mode*i/n);
+  }
+
+  c->window = plasmaPeriodSteps(param);
+  c->history = (double *)malloc((size_t)CADENCE_MONITORS*c->window*sizeof(double));
+  for (m=0; m<CADENCE_MONITORS; m++) {
+    c->sum[m] = 0;
+    c->atOutput[m] = -1;
+  }
+  c->filled = 0;
+  c->next = 0;
+  c->sinceOutput = 0;
+  printf("# Adaptive output: envelope over %d steps (one plasma period)\n", c->window);
+
+  return c;
+}
+
+/* |ln(now/before)|: relative change of an envelope (one that starts
+   from, or falls to, zero has changed without bound) */
+static double logChange(double now, double before)
+{
+  if (now > 0 && before > 0) return fabs(log(now/before));
+  if (now == before) return 0;
+  return HUGE_VAL;
+}
+
+/* Takes the monitors of field E (n grid points, the last one the
+   periodic image of the first), and adds them to their envelopes.
+   Returns 1 if an output is due (the state is then that of the
+   output).
+ */
+int outputDue(struct outputCadence *c, struct vector2D *E, int n, struct parameters param)
+{
+  double fieldEnergy = 0, maxE = 0, re = 0, im = 0, change = 0, envelope[CADENCE_MONITORS];
+  double *slot = c->history + (size_t)CADENCE_MONITORS*c->next;
+  int i, m, due;
+
+  for (i=0; i<n-1; i++) {
+    fieldEnergy += E[i].x*E[i].x + E[i].y*E[i].y;
+    if (fabs(E[i].x) > maxE) maxE = fabs(E[i].x);
+    re += E[i].x*c->modeCos[i];
+    im -= E[i].x*c->modeSin[i];
+  }
+
+  /* Squares of the monitors, in place of the oldest ones of the window */
+  for (m=0; m<CADENCE_MONITORS; m++) {
+    if (c->filled == c->window) c->sum[m] -= slot[m];
+  }
+  slot[0] = fieldEnergy;
+  slot[1] = maxE*maxE;
+  slot[2] = re*re + im*im;
+  for (m=0; m<CADENCE_MONITORS; m++) c->sum[m] += slot[m];
+  if (c->filled < c->window) c->filled++;
+  c->next = (c->next + 1) % c->window;
+
+  /* Sums taken afresh once per window (no drift of the running sums) */
+  if (c->next == 0) {
+    for (m=0; m<CADENCE_MONITORS; m++) {
+      c->sum[m] = 0;
+      for (i=0; i<c->filled; i++) c->sum[m] += c->history[(size_t)CADENCE_MONITORS*i + m];
+    }
+  }
+
+  /* Envelopes (RMS over the window) and their change since the last
+     output. Until the window is full there is no envelope yet (outputs
+     come at the largest interval), the first full one is the reference */
+  for (m=0; m<CADENCE_MONITORS; m++) {
+    envelope[m] = sqrt(fmax(c->sum[m], 0)/c->filled);
+    if (c->filled < c->window) continue;
+    if (c->atOutput[m] < 0) c->atOutput[m] = envelope[m];
+    if (logChange(envelope[m], c->atOutput[m]) > change) change = logChange(envelope[m], c->atOutput[m]);
+  }
+  c->sinceOutput++;
+
+  due = (c->sinceOutput >= param.minInterval && change >= param.outputThreshold) ||
+        c->sinceOutput >= param.maxInterval;
+  if (due) {
+    if (c->filled == c->window) {
+      for (m=0; m<CADENCE_MONITORS; m++) c->atOutput[m] = envelope[m];
+    }
+    c->sinceOutput = 0;
+  }
+
+  return due;
+}
+
+/* Frees the adaptive output state */
+void deAllocateCadence(struct outputCadence *c)
+{
+  free(c->modeCos); free(c->modeSin);
+  free(c->history);
+}
@@ -0,0 +1,354 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Compressed Snapshots
+ ***
+ *** Binary snapshots of the grid (rho, u, E, J) at every output,
+ *** compressed in-tree (no external library) into
+ *** <prefix>snapshots.bin (see analysis/read_snapshots.py):
+ ***   lossless:      bits of every value XOR those of its left
+ ***                  neighbour (smooth fields: leading bytes vanish),
+ ***   error-bounded: values quantised to multiples of 2*tolerance
+ ***                  (|error| <= tolerance), differences of
+ ***                  neighbouring quanta (small integers, zigzag coded),
+ *** then the 8 bytes of every value are shuffled into byte planes
+ *** (plane k holds byte k of all values), and the planes are run
+ *** length coded (mostly zero planes shrink to almost nothing).
+ ***
+ *** Compression and writing run in a thread of their own: an output
+ *** only copies the arrays into a free slot, so the time steps do not
+ *** wait for the disk. If the writer falls N_SLOTS outputs behind,
+ *** the next output waits for a free slot (no snapshot is dropped).
+ ***
+ *** File layout (native byte order):
+ ***   header:    char magic[4] = "PICZ", int32 version (1),
+ ***              int32 grid points, int32 variables per snapshot,
+ ***              double dx, double xMin
+ ***   snapshots: int32 output, int32 step, double time, then for
+ ***              every variable: char name[8], int32 coding
+ ***              (1: lossless, 2: error-bounded), int32 bytes,
+ ***              double quantum (coding 2: 2*tolerance), bytes
+ ***
+ *** Run length code: control byte c < 128: c+1 literal bytes follow,
+ *** c >= 128: the next byte repeated c-125 times (3 to 130).
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../headers/structs.h"
+#include "../headers/io.h"
+
+#define N_SLOTS 4
+#define N_SNAPSHOT_VARIABLES 6
+#define MAX_REPEAT 130
+#define MAX_LITERAL 128
+
+/* Coding of a variable */
+#define CODING_LOSSLESS 1
+#define CODING_BOUNDED 2
+
+static const char *snapshotNames[N_SNAPSHOT_VARIABLES] = {"rho", "u", "E_x", "E_y", "J_x", "J_y"};
+
+/* One snapshot waiting to be written */
+struct snapshotSlot {
+  double *values;
+  int output, step, full;
+  double time;
+};
+
+/* snapshotWriter structure (opaque outside this file: it holds the
+   writer thread). Slots are filled in turn by the simulation (head)
+   and emptied in turn by the writer (tail).
+ */
+struct snapshotWriter {
+  int fd, failed, nGridPoints, mode;
+  double tolerance;
+
+  struct snapshotSlot slot[N_SLOTS];
+  int head, tail, done;
+  atomic_int waiting;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  /* Work arrays of the writer */
+  uint64_t *words;
+  unsigned char *planes, *coded;
+
+  int nSnapshots;
+  long rawBytes, codedBytes;
+};
+
+/* Writes n bytes to the snapshot file. The first error is reported,
+   and nothing is written after it. */
+static void writeSnapshotData(struct snapshotWriter *sw, const void *data, size_t n)
+{
+  if (sw->failed) return;
+  if (writeAll(sw->fd, data, n) != 0) {
+    printf("# Note: cannot write the snapshots (%s), snapshots.bin is incomplete.\n", strerror(errno));
+    sw->failed = 1;
+  }
+}
+
+/* Run length code of in[0..n-1] into out (at most n + n/128 + 1 bytes).
+   Returns number of bytes written.
+ */
+static size_t runLengthCode(const unsigned char *in, size_t n, unsigned char *out)
+{
+  size_t i = 0, o = 0, r, literal;
+
+  while (i < n) {
+    /* Repeat run at i? */
+    for (r=1; i + r < n && r < MAX_REPEAT && in[i + r] == in[i]; r++);
+    if (r >= 3) {
+      out[o++] = (unsigned char)(r + 125);
+      out[o++] = in[i];
+      i += r;
+      continue;
+    }
+
+    /* Literals up to the next repeat run (of 3 or more) */
+    for (literal=0; i + literal < n && literal < MAX_LITERAL; literal++) {
+      if (i + literal + 2 < n && in[i + literal] == in[i + literal + 1] &&
+          in[i + literal] == in[i + literal + 2]) break;
+    }
+    out[o++] = (unsigned char)(literal - 1);
+    memcpy(out + o, in + i, literal);
+    o += literal;
+    i += literal;
+  }
+
+  return o;
+}
+
+/* Codes n values of a (lossless, or error-bounded with quantum
+   2*tolerance) into out. Falls back to lossless when the values do
+   not fit the quantisation. Returns number of bytes, and the coding
+   used in *coding and the quantum in *quantum.
+ */
+static size_t codeVariable(struct snapshotWriter *sw, const double *a, int n,
+                           unsigned char *out, int *coding, double *quantum)
+{
+  uint64_t *w = sw->words, bits, previous = 0;
+  int64_t q, qPrevious = 0, d;
+  double x;
+  int i, k;
+
+  *coding = CODING_LOSSLESS;
+  *quantum = 0;
+
+  /* Error-bounded: zigzag coded differences of the quanta */
+  if (sw->mode == CODING_BOUNDED) {
+    *quantum = 2*sw->tolerance;
+    for (i=0; i<n; i++) {
+      x = a[i]/(*quantum);
+      if (!(fabs(x) < 4503599627370496.0)) break;   /* 2^52, or not finite */
+      q = llround(x);
+      d = q - qPrevious;
+      qPrevious = q;
+      w[i] = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+    }
+    if (i == n) *coding = CODING_BOUNDED;
+    else *quantum = 0;
+  }
+
+  /* Lossless: bits XOR bits of the left neighbour */
+  if (*coding == CODING_LOSSLESS) {
+    for (i=0; i<n; i++) {
+      memcpy(&bits, &a[i], sizeof(bits));
+      w[i] = bits ^ previous;
+      previous = bits;
+    }
+  }
+
+  /* Byte planes (little end first), then run lengths */
+  for (k=0; k<8; k++) {
+    for (i=0; i<n; i++) {
+      sw->planes[(size_t)k*n + i] = (unsigned char)(w[i] >> (8*k));
+    }
+  }
+
+  return runLengthCode(sw->planes, (size_t)8*n, out);
+}
+
+/* Codes and writes one snapshot */
+static void writeSlot(struct snapshotWriter *sw, struct snapshotSlot *slot)
+{
+  int32_t record[2] = {slot->output, slot->step}, variable[2];
+  char name[8];
+  double quantum;
+  size_t size, length;
+  int v, coding, n = sw->nGridPoints;
+
+  writeSnapshotData(sw, record, sizeof(record));
+  writeSnapshotData(sw, &slot->time, sizeof(double));
+
+  for (v=0; v<N_SNAPSHOT_VARIABLES; v++) {
+    size = codeVariable(sw, slot->values + (size_t)v*n, n, sw->coded, &coding, &quantum);
+
+    /* Zero padded, not terminated if 8 long */
+    memset(name, 0, sizeof(name));
+    length = strlen(snapshotNames[v]);
+    memcpy(name, snapshotNames[v], length < sizeof(name) ? length : sizeof(name));
+    variable[0] = coding;
+    variable[1] = (int32_t)size;
+    writeSnapshotData(sw, name, sizeof(name));
+    writeSnapshotData(sw, variable, sizeof(variable));
+    writeSnapshotData(sw, &quantum, sizeof(double));
+    writeSnapshotData(sw, sw->coded, size);
+
+    sw->rawBytes += (long)n*sizeof(double);
+    sw->codedBytes += sizeof(name) + sizeof(variable) + sizeof(double) + size;
+  }
+  sw->nSnapshots++;
+}
+
+/* Writer thread: writes the full slots in turn until closed */
+static void * snapshotThread(void *arg)
+{
+  struct snapshotWriter *sw = (struct snapshotWriter *)arg;
+  struct snapshotSlot *slot;
+
+  pthread_mutex_lock(&sw->lock);
+  while (1) {
+    slot = &sw->slot[sw->tail];
+    if (!slot->full) {
+      if (sw->done) break;
+      pthread_cond_wait(&sw->changed, &sw->lock);
+      continue;
+    }
+
+    pthread_mutex_unlock(&sw->lock);
+    writeSlot(sw, slot);
+    pthread_mutex_lock(&sw->lock);
+
+    slot->full = 0;
+    sw->tail = (sw->tail + 1) % N_SLOTS;
+    atomic_fetch_sub_explicit(&sw->waiting, 1, memory_order_relaxed);
+    pthread_cond_broadcast(&sw->changed);
+  }
+  pthread_mutex_unlock(&sw->lock);
+
+  return NULL;
+}
+
+/* Opens <prefix>snapshots.bin and starts the writer thread.
+   Returns NULL if the file cannot be created.
+ */
+struct snapshotWriter * openSnapshots(struct parameters param, double dx, char *prefix)
+{
+  char filename[PATH_LENGTH];
+  struct snapshotWriter *sw;
+  int32_t header[4];
+  int k, n = param.nGridPoints;
+
+  snprintf(filename, PATH_LENGTH, "%ssnapshots.bin", prefix);
+  sw = (struct snapshotWriter *)malloc(sizeof(struct snapshotWriter));
+  sw->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (sw->fd < 0) {
+    free(sw);
+    return NULL;
+  }
+
+  sw->nGridPoints = n;
+  sw->mode = (param.snapshotMode == CODING_BOUNDED && param.snapshotTolerance > 0) ?
+             CODING_BOUNDED : CODING_LOSSLESS;
+  sw->tolerance = param.snapshotTolerance;
+  for (k=0; k<N_SLOTS; k++) {
+    sw->slot[k].values = (double *)malloc((size_t)N_SNAPSHOT_VARIABLES*n*sizeof(double));
+    sw->slot[k].full = 0;
+  }
+  sw->words = (uint64_t *)malloc((size_t)n*sizeof(uint64_t));
+  sw->planes = (unsigned char *)malloc((size_t)8*n);
+  sw->coded = (unsigned char *)malloc((size_t)8*n + (size_t)8*n/MAX_LITERAL + 16);
+  sw->head = sw->tail = sw->done = 0;
+  atomic_init(&sw->waiting, 0);
+  sw->nSnapshots = 0;
+  sw->failed = 0;
+  sw->rawBytes = sw->codedBytes = 0;
+
+  memcpy(&header[0], "PICZ", 4);
+  header[1] = 1;
+  header[2] = n;
+  header[3] = N_SNAPSHOT_VARIABLES;
+  writeSnapshotData(sw, header, sizeof(header));
+  writeSnapshotData(sw, &dx, sizeof(double));
+  writeSnapshotData(sw, &param.gridStart, sizeof(double));
+
+  pthread_mutex_init(&sw->lock, NULL);
+  pthread_cond_init(&sw->changed, NULL);
+  pthread_create(&sw->thread, NULL, snapshotThread, sw);
+
+  return sw;
+}
+
+/* Hands the grid at output number "output" to the writer
+   (waits only if all slots are still waiting to be written) */
+void writeSnapshot(struct simulation *s, int output)
+{
+  struct snapshotWriter *sw = s->snapshots;
+  struct snapshotSlot *slot;
+  double *v;
+  int i, n = sw->nGridPoints;
+
+  pthread_mutex_lock(&sw->lock);
+  slot = &sw->slot[sw->head];
+  while (slot->full) pthread_cond_wait(&sw->changed, &sw->lock);
+  pthread_mutex_unlock(&sw->lock);
+
+  v = slot->values;
+  memcpy(v, s->g->rho, n*sizeof(double));
+  memcpy(v + n, s->g->u, n*sizeof(double));
+  for (i=0; i<n; i++) {
+    v[2*n + i] = s->f->E[i].x;
+    v[3*n + i] = s->f->E[i].y;
+    v[4*n + i] = s->g->J[i].x;
+    v[5*n + i] = s->g->J[i].y;
+  }
+  slot->output = output;
+  slot->step = s->step;
+  slot->time = s->step*s->param.dt;
+
+  pthread_mutex_lock(&sw->lock);
+  slot->full = 1;
+  sw->head = (sw->head + 1) % N_SLOTS;
+  atomic_fetch_add_explicit(&sw->waiting, 1, memory_order_relaxed);
+  pthread_cond_broadcast(&sw->changed);
+  pthread_mutex_unlock(&sw->lock);
+}
+
+/* Number of snapshots waiting to be written (live metrics: a counter
+   kept along by both sides, read without taking the lock) */
+int snapshotsWaiting(struct snapshotWriter *sw)
+{
+  return atomic_load_explicit(&sw->waiting, memory_order_relaxed);
+}
+
+/* Writes the waiting snapshots, stops the writer and closes the file */
+void closeSnapshots(struct snapshotWriter *sw)
+{
+  int k;
+
+  pthread_mutex_lock(&sw->lock);
+  sw->done = 1;
+  pthread_cond_broadcast(&sw->changed);
+  pthread_mutex_unlock(&sw->lock);
+  pthread_join(sw->thread, NULL);
+
+  close(sw->fd);
+  if (sw->codedBytes > 0) {
+    printf("# Snapshots: %d, %.2f MB (%.1f times smaller than raw)\n", sw->nSnapshots,
+           sw->codedBytes/1048576.0, (double)sw->rawBytes/sw->codedBytes);
+  }
+
+  pthread_mutex_destroy(&sw->lock);
+  pthread_cond_destroy(&sw->changed);
+  for (k=0; k<N_SLOTS; k++) free(sw->slot[k].values);
+  free(sw->words); free(sw->planes); free(sw->coded);
+}
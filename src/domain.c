@@ -0,0 +1,695 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Domain Decomposition
+ ***
+ *** Each domain owns a contiguous x-range of the grid and the
+ *** particles inside it, and is handled by one thread (domain d
+ *** goes to thread d%nThreads, so normally nDomains = nThreads).
+ *** Every domain keeps a slice of the grid of its own: its points
+ *** and nGuards guard points on both sides, which belong to the
+ *** neighbours. The time step works on the slices only:
+ ***   - Deposition goes to the slice, and the guard points are
+ ***     then added to the neighbours' points.
+ ***   - Poisson's equation is solved with red-black Gauss-Seidel,
+ ***     each domain updating its own points (the potential of the
+ ***     guard points is taken from the neighbours between sweeps).
+ ***   - Gather reads E of the slice, whose guard points are taken
+ ***     from the neighbours after the field solve.
+ ***   - Particles leaving a domain migrate to the neighbour.
+ ***     The periodic seam is an exchange between the last and
+ ***     the first domain (this replaces checkPeriodic).
+ *** The global grid is written only for output (collectDomains).
+ *** The guard points cover the farthest the fastest particle gets
+ *** in one step, and are widened before a step when particles got
+ *** faster (fitGuards). Particles that pass a whole domain in one
+ *** step are handed on until they reach the one that owns them.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../headers/structs.h"
+#include "../headers/memory.h"
+#include "../headers/mover.h"
+#include "../headers/setup.h"
+#include "../headers/definitions.h"
+#include "../headers/shape.h"
+#include "../headers/phasespace.h"
+
+/* Guard points on either side at least: the deposition of the owned
+   cells reaches one point to the left and two to the right */
+#define MIN_GUARDS 2
+
+/* Index of grid point i (global index, not wrapped) in the slice of domain s */
+static inline int localPoint(struct domain *s, int i)
+{
+  return i - s->firstCell + s->nGuards;
+}
+
+/* Copies Bz (constant) of the grid to the slice of domain s */
+static void sliceBz(struct domain *s, double *Bz, int nCells)
+{
+  int i;
+
+  for (i=0; i<s->nLocal; i++) {
+    s->f.Bz[i] = Bz[(s->firstCell - s->nGuards + i + nCells)%nCells];
+  }
+}
+
+/* Splits the grid cells evenly into param.nDomains domains, and
+   allocates their slices (Bz, constant, is copied from the grid) */
+struct domain * allocateDomains(struct parameters param, double *Bz)
+{
+  int d, nCells;
+  struct domain *dom;
+
+  dom = (struct domain *)malloc(param.nDomains * sizeof(struct domain));
+  nCells = param.nGridPoints - 1;
+
+  /* Every domain allocates (and so first touches) its own arrays, 
+     on the thread that will work on it */
+  #pragma omp parallel for schedule(static,1)
+  for (d=0; d<param.nDomains; d++) {
+    struct domain *s = &dom[d];
+    int nLocal;
+
+    s->firstCell = (d*nCells)/param.nDomains;
+    s->lastCell = ((d+1)*nCells)/param.nDomains;
+
+    /* Leave some room for density fluctuations */
+    s->ions = allocateParticleBuffer(2*(param.nIons/param.nDomains) + 16);
+    s->electrons = allocateParticleBuffer(2*(param.nElectrons/param.nDomains) + 16);
+
+    s->ionsLeft = allocateParticleBuffer(16);
+    s->ionsRight = allocateParticleBuffer(16);
+    s->electronsLeft = allocateParticleBuffer(16);
+    s->electronsRight = allocateParticleBuffer(16);
+    s->ionsPassLeft = allocateParticleBuffer(16);
+    s->ionsPassRight = allocateParticleBuffer(16);
+    s->electronsPassLeft = allocateParticleBuffer(16);
+    s->electronsPassRight = allocateParticleBuffer(16);
+
+    /* Grid slice (the potential starts from zero, as on the grid) */
+    s->nGuards = MIN_GUARDS;
+    nLocal = s->lastCell - s->firstCell + 2*s->nGuards;
+    s->nLocal = nLocal;
+    s->n_i = (double *)calloc(nLocal, sizeof(double));
+    s->n_e = (double *)calloc(nLocal, sizeof(double));
+    s->rho = (double *)calloc(nLocal, sizeof(double));
+    s->u = (double *)calloc(nLocal, sizeof(double));
+    s->J_i = (struct vector2D *)calloc(nLocal, sizeof(struct vector2D));
+    s->J_e = (struct vector2D *)calloc(nLocal, sizeof(struct vector2D));
+    s->J = (struct vector2D *)calloc(nLocal, sizeof(struct vector2D));
+
+    s->f.E = (struct vector2D *)calloc(nLocal, sizeof(struct vector2D));
+    s->f.Bz = (double *)malloc(nLocal * sizeof(double));
+    sliceBz(s, Bz, nCells);
+    s->f.nGridPoints = nLocal;
+    s->f.open = 0;
+    s->f.slice = 1;
+    s->f.firstPoint = s->firstCell - s->nGuards;
+    s->maxSpeed = 0;
+    s->residual = 0;
+  }
+
+  return dom;
+}
+
+/* Domain De-Allocator */
+void deAllocateDomains(struct domain *dom, int nDomains)
+{
+  int d;
+
+  for (d=0; d<nDomains; d++) {
+    deAllocateParticleBuffer(dom[d].ions);
+    deAllocateParticleBuffer(dom[d].electrons);
+    deAllocateParticleBuffer(dom[d].ionsLeft);
+    deAllocateParticleBuffer(dom[d].ionsRight);
+    deAllocateParticleBuffer(dom[d].electronsLeft);
+    deAllocateParticleBuffer(dom[d].electronsRight);
+    deAllocateParticleBuffer(dom[d].ionsPassLeft);
+    deAllocateParticleBuffer(dom[d].ionsPassRight);
+    deAllocateParticleBuffer(dom[d].electronsPassLeft);
+    deAllocateParticleBuffer(dom[d].electronsPassRight);
+    free(dom[d].n_i); free(dom[d].n_e);
+    free(dom[d].rho); free(dom[d].u);
+    free(dom[d].J_i); free(dom[d].J_e); free(dom[d].J);
+    free(dom[d].f.E); free(dom[d].f.Bz);
+  }
+}
+
+/* Returns index of the domain that owns the given cell */
+int findDomain(struct domain *dom, int nDomains, int cell)
+{
+  int d;
+
+  for (d=0; d<nDomains-1; d++) {
+    if (cell < dom[d].lastCell) break;
+  }
+
+  return d;
+}
+
+/* Hands the (already set up) particles over to the domains that own
+   them (and notes the fastest of every domain) */
+struct domain * distributeParticles(struct domain *dom, struct particle *ions, struct particle *electrons,
+                                    struct parameters param, double dx)
+{
+  long i;
+  int d;
+
+  for (i=0; i<param.nIons; i++) {
+    d = findDomain(dom, param.nDomains, PARTICLE_CELL(ions[i], dx));
+    dom[d].ions = appendParticle(dom[d].ions, ions[i]);
+    dom[d].maxSpeed = fmax(dom[d].maxSpeed, fabs(ions[i].v.x));
+  }
+  for (i=0; i<param.nElectrons; i++) {
+    d = findDomain(dom, param.nDomains, PARTICLE_CELL(electrons[i], dx));
+    dom[d].electrons = appendParticle(dom[d].electrons, electrons[i]);
+    dom[d].maxSpeed = fmax(dom[d].maxSpeed, fabs(electrons[i].v.x));
+  }
+
+  return dom;
+}
+
+/* Slice array a (nOld elements of "size" bytes) in a new one of nNew
+   elements, moved by "shift" elements (the new ones are zero) */
+static void * widenSlice(void *a, size_t size, int nOld, int shift, int nNew)
+{
+  char *b = (char *)calloc(nNew, size);
+
+  memcpy(b + shift*size, a, nOld*size);
+  free(a);
+
+  return b;
+}
+
+/* Widens the guard points of all slices when the fastest particle can
+   get farther than they reach in the next step: MIN_GUARDS plus twice
+   its distance in one step (room for the acceleration), at most half
+   the grid (beyond, the field of the push is cut at the last guard
+   point, with a warning).
+   The potential is kept (the warm start of the Poisson solver).
+ */
+void fitGuards(struct domain *dom, int nDomains, double *Bz, int nCells, double dt, double dx)
+{
+  int d, nGuards;
+  double maxSpeed = 0, reach;
+
+  for (d=0; d<nDomains; d++) maxSpeed = fmax(maxSpeed, dom[d].maxSpeed);
+  reach = ceil(2*maxSpeed*dt/dx);
+  nGuards = (reach < nCells/2 - MIN_GUARDS) ? MIN_GUARDS + (int)reach : nCells/2;
+  if (nGuards <= dom[0].nGuards) return;
+
+  if (nGuards == nCells/2) {
+    printf("\n*****************************************\n");
+    printf("Warning: Particles move up to %g cells in one time step!\n", maxSpeed*dt/dx);
+    printf("Their field is cut at %d cells from their domain.\n\n", nGuards);
+    printf("*****************************************\n\n");
+  }
+
+  #pragma omp parallel for schedule(static,1)
+  for (d=0; d<nDomains; d++) {
+    struct domain *s = &dom[d];
+    int shift = nGuards - s->nGuards, nOld = s->nLocal, nLocal = nOld + 2*shift;
+
+    s->n_i = (double *)widenSlice(s->n_i, sizeof(double), nOld, shift, nLocal);
+    s->n_e = (double *)widenSlice(s->n_e, sizeof(double), nOld, shift, nLocal);
+    s->rho = (double *)widenSlice(s->rho, sizeof(double), nOld, shift, nLocal);
+    s->u = (double *)widenSlice(s->u, sizeof(double), nOld, shift, nLocal);
+    s->J_i = (struct vector2D *)widenSlice(s->J_i, sizeof(struct vector2D), nOld, shift, nLocal);
+    s->J_e = (struct vector2D *)widenSlice(s->J_e, sizeof(struct vector2D), nOld, shift, nLocal);
+    s->J = (struct vector2D *)widenSlice(s->J, sizeof(struct vector2D), nOld, shift, nLocal);
+    s->f.E = (struct vector2D *)widenSlice(s->f.E, sizeof(struct vector2D), nOld, shift, nLocal);
+    s->f.Bz = (double *)widenSlice(s->f.Bz, sizeof(double), nOld, shift, nLocal);
+
+    s->nGuards = nGuards;
+    s->nLocal = nLocal;
+    sliceBz(s, Bz, nCells);
+    s->f.nGridPoints = nLocal;
+    s->f.firstPoint = s->firstCell - nGuards;
+  }
+}
+
+/****************************************************************
+  Deposition (particles to grid)
+ ****************************************************************/
+
+/* Deposition of one species to the slice arrays n, j of domain s
+   (see nShape, jShape). Particles of the owned cells reach grid
+   points firstCell-1 ... lastCell+1 with any shape in shape.h.
+   If h is not NULL, particles are also added to phase space histogram h.
+ */
+void depositSpecies(double *n, struct vector2D *j, struct particleBuffer b,
+                    struct domain *s, double dx,
+                    double *h, struct phaseSpace *ph, int species)
+{
+  long i;
+  int k, cell, first;
+  double x, w[SHAPE_POINTS];
+
+  for (i=0; i<s->nLocal; i++) {
+    n[i] = 0;
+    j[i].x = 0;
+    j[i].y = 0;
+  }
+
+  for (i=0; i<b.n; i++) {
+    cell = PARTICLE_CELL(b.p[i], dx);
+    x = PARTICLE_X(b.p[i], dx);
+
+    first = localPoint(s, shapeWeights(x, cell, dx, w));
+    for (k=0; k<SHAPE_POINTS; k++) {
+      n[first + k] += w[k]*b.p[i].w/dx;
+      j[first + k].x += w[k]*b.p[i].w*b.p[i].v.x/dx;
+      j[first + k].y += w[k]*b.p[i].w*b.p[i].v.y/dx;
+    }
+
+    if (h != NULL) addToPhaseSpace(h, ph, species, x, b.p[i].v.x, b.p[i].w);
+  }
+}
+
+/* Adds guard point "point" (global index, possibly outside the grid)
+   of domain "from" to the slice of domain "to", if its periodic image
+   is owned by "to".
+ */
+void addGuardPoint(struct domain *from, struct domain *to, int point, int nCells)
+{
+  int i = (point + nCells)%nCells;
+  int j = localPoint(from, point), k;
+
+  if (i < to->firstCell || i >= to->lastCell) return;
+
+  k = localPoint(to, i);
+  to->n_i[k] += from->n_i[j];
+  to->n_e[k] += from->n_e[j];
+  to->J_i[k].x += from->J_i[j].x;
+  to->J_i[k].y += from->J_i[j].y;
+  to->J_e[k].x += from->J_e[j].x;
+  to->J_e[k].y += from->J_e[j].y;
+}
+
+/* Completes the owned points of domain d: adds the right guard points
+   of the left neighbour and the left guard point of the right
+   neighbour, and finds the densities. Only owned points are written,
+   and only guard points are read from the neighbours.
+   For the first and last domain the neighbours are across the 
+   periodic seam (as the fold in nShape).
+ */
+void reduceGuards(struct domain *dom, int d, int nDomains, int nCells, double dx)
+{
+  int i, j;
+  struct domain *s = &dom[d];
+  struct domain *left = &dom[(d - 1 + nDomains)%nDomains];
+  struct domain *right = &dom[(d + 1)%nDomains];
+
+  /* Neighbours' guard points */
+  addGuardPoint(left, s, left->lastCell, nCells);
+  addGuardPoint(left, s, left->lastCell + 1, nCells);
+  addGuardPoint(right, s, right->firstCell - 1, nCells);
+
+  /* Actual densities */
+  for (i=s->firstCell; i<s->lastCell; i++) {
+    j = localPoint(s, i);
+    s->n_i[j] /= dx;
+    s->n_e[j] /= dx;
+    s->J_i[j].x /= dx; s->J_i[j].y /= dx;
+    s->J_e[j].x /= dx; s->J_e[j].y /= dx;
+
+    s->rho[j] = s->n_i[j]*ION_CHARGE + s->n_e[j]*ELECTRON_CHARGE;
+    s->J[j].x = s->J_i[j].x*ION_CHARGE + s->J_e[j].x*ELECTRON_CHARGE;
+    s->J[j].y = s->J_i[j].y*ION_CHARGE + s->J_e[j].y*ELECTRON_CHARGE;
+  }
+}
+
+/* Takes the guard points of the potential (field = 0) or of E
+   (field = 1) of domain d from the domains that own them (across
+   the periodic seam for the first and last domain): normally the
+   neighbours, further ones when the guard points are wider than them.
+ */
+void exchangeGuards(struct domain *dom, int d, int nDomains, int nCells, int field)
+{
+  struct domain *s = &dom[d], *from;
+  int k, point, i;
+
+  for (k=0; k<2*s->nGuards; k++) {
+    if (k < s->nGuards) {
+      point = s->firstCell - s->nGuards + k;
+      from = &dom[(d - 1 + nDomains)%nDomains];
+    }
+    else {
+      point = s->lastCell + k - s->nGuards;
+      from = &dom[(d + 1)%nDomains];
+    }
+    i = (point + nCells)%nCells;
+    if (i < from->firstCell || i >= from->lastCell) from = &dom[findDomain(dom, nDomains, i)];
+    i = localPoint(from, i);
+    if (field) s->f.E[localPoint(s, point)] = from->f.E[i];
+    else s->u[localPoint(s, point)] = from->u[i];
+  }
+}
+
+/* Writes the slices of the domains to the global grid and field, for
+   output (the time step itself works on the slices only) */
+void collectDomains(struct domain *dom, int nDomains, struct grid *g, struct field *f, int nGridPoints)
+{
+  int d, i, j, last = nGridPoints - 1;
+
+  for (d=0; d<nDomains; d++) {
+    for (i=dom[d].firstCell; i<dom[d].lastCell; i++) {
+      j = localPoint(&dom[d], i);
+      g->n_i[i] = dom[d].n_i[j];
+      g->n_e[i] = dom[d].n_e[j];
+      g->rho[i] = dom[d].rho[j];
+      g->u[i] = dom[d].u[j];
+      g->J_i[i] = dom[d].J_i[j];
+      g->J_e[i] = dom[d].J_e[j];
+      g->J[i] = dom[d].J[j];
+      f->E[i] = dom[d].f.E[j];
+    }
+  }
+
+  /* Last point: periodic image of the first (the potential keeps its
+     boundary value) */
+  g->n_i[last] = g->n_i[0];
+  g->n_e[last] = g->n_e[0];
+  g->rho[last] = g->rho[0];
+  g->J_i[last] = g->J_i[0];
+  g->J_e[last] = g->J_e[0];
+  g->J[last] = g->J[0];
+  f->E[last].x = f->E[0].x;
+}
+
+/****************************************************************
+  Distributed Poisson solver
+ ****************************************************************/
+
+/* Red-black Gauss-Seidel sweep over the inner points owned by
+   domain d. Only points with i%2 == color are updated, so that
+   domains never update neighbouring points at the same time: the
+   guard points next to the owned ones (of the other color, so not
+   being updated) are taken from the neighbours first.
+ */
+void redBlackSweep(struct domain *dom, int d, int nDomains, double h, int size, int color)
+{
+  struct domain *s = &dom[d];
+  int i, j, first = s->firstCell, last = s->lastCell;
+
+  if (d > 0 && (first - 1)%2 != color) {
+    s->u[localPoint(s, first - 1)] = dom[d-1].u[localPoint(&dom[d-1], first - 1)];
+  }
+  if (d < nDomains - 1 && last%2 != color) {
+    s->u[localPoint(s, last)] = dom[d+1].u[localPoint(&dom[d+1], last)];
+  }
+
+  if (first < 1) first = 1;
+  if (last > size - 1) last = size - 1;
+  if (first%2 != color) first++;
+
+  for (i=first; i<last; i+=2) {
+    j = localPoint(s, i);
+    s->u[j] = 0.5*(s->u[j-1] + s->u[j+1] + h*h*s->rho[j]);
+  }
+}
+
+/* Squared residual over the inner points owned by a domain
+   (guard points of the potential up to date) */
+double domainResidual(struct domain *s, double h, int size)
+{
+  int i, j, first = s->firstCell, last = s->lastCell;
+  double Ax_r, res;
+
+  if (first < 1) first = 1;
+  if (last > size - 1) last = size - 1;
+
+  res = 0;
+  for (i=first; i<last; i++) {
+    j = localPoint(s, i);
+    Ax_r = (s->u[j-1] - 2*s->u[j] + s->u[j+1] + h*h*s->rho[j]);
+    res += Ax_r*Ax_r;
+  }
+
+  return res;
+}
+
+/* Distributed version of poisson1D on the slices. Must be called by
+   all threads of the parallel region. res and nIterations must be
+   shared. Same iteration limit and tolerance as poisson1D.
+   On return the guard points of the potential are up to date.
+ */
+void poissonDecomposed(struct domain *dom, int nDomains, int size, double h,
+                       double *res, int *nIterations)
+{
+  int d, t, color, maxIterations, iterationsPerCheck;
+  double tolerance;
+
+  maxIterations = 16*size*size;
+  iterationsPerCheck = 100;
+  tolerance = size * pow(10.0, -8);
+
+  #pragma omp single
+  *nIterations = 0;
+
+  do {
+    for (t=0; t<iterationsPerCheck; t++) {
+      for (color=0; color<2; color++) {
+        #pragma omp for schedule(static,1)
+        for (d=0; d<nDomains; d++) {
+          redBlackSweep(dom, d, nDomains, h, size, color);
+        }
+      }
+    }
+
+    #pragma omp for schedule(static,1)
+    for (d=0; d<nDomains; d++) {
+      exchangeGuards(dom, d, nDomains, size - 1, 0);
+      dom[d].residual = domainResidual(&dom[d], h, size);
+    }
+
+    #pragma omp single
+    {
+      *res = 0;
+      for (d=0; d<nDomains; d++) *res += dom[d].residual;
+      *res = sqrt(*res);
+      *nIterations += iterationsPerCheck;
+    }
+  } while (*res > tolerance && *nIterations <= maxIterations);
+
+  #pragma omp single
+  if (*nIterations > maxIterations) {
+    printf("\n*****************************************\n");
+    printf("Warning: Maximum Iterations (%d) reached!\n", maxIterations);
+    printf("Residual: %e\n\n", *res);
+    printf("*****************************************\n\n");
+  }
+}
+
+/* E_x = -du/dx on the points owned by a domain (see findEx_fromPotential:
+   the left guard point of the first domain is the periodic image) */
+void domainFindEx(struct domain *s, double dx)
+{
+  int i, j;
+
+  for (i=s->firstCell; i<s->lastCell; i++) {
+    j = localPoint(s, i);
+    s->f.E[j].x = - (s->u[j+1] - s->u[j-1])/(2*dx);
+  }
+}
+
+/****************************************************************
+  Particle push and migration
+ ****************************************************************/
+
+/* Moves all particles of one species in a domain, 
+   with the species' mover (moveIon or moveElectron).
+   The fastest |v_x| after the push goes to maxSpeed (if larger).
+ */
+struct particleBuffer pushSpecies(struct particleBuffer b,
+                                  struct particle (*move)(struct particle, struct field *, double, double),
+                                  struct field *f, double dx, double dt, double *maxSpeed)
+{
+  long i;
+  double v = *maxSpeed;
+
+  for (i=0; i<b.n; i++) {
+    b.p[i] = move(b.p[i], f, dx, dt);
+    v = fmax(v, fabs(b.p[i].v.x));
+  }
+  *maxSpeed = v;
+
+  return b;
+}
+
+/* Removes particles that left cells [firstCell, lastCell) from b
+   and puts them in the left/right outgoing buffers.
+   Particles crossing the periodic seam are wrapped here.
+ */
+void sendParticles(struct particleBuffer *b, struct particleBuffer *left, struct particleBuffer *right,
+                   int firstCell, int lastCell, int nCells, double length, double dx)
+{
+  long i;
+  int cell;
+  struct particle p;
+
+  left->n = 0;
+  right->n = 0;
+
+  i = 0;
+  while (i < b->n) {
+    cell = PARTICLE_CELL(b->p[i], dx);
+    if (cell >= firstCell && cell < lastCell) {
+      i++;
+      continue;
+    }
+
+    p = b->p[i];
+    if (cell < firstCell) {
+      while (PARTICLE_CELL(p, dx) < 0) p = setParticleX(p, PARTICLE_X(p, dx) + length, dx);
+      *left = appendParticle(*left, p);
+    }
+    else {
+      while (PARTICLE_CELL(p, dx) >= nCells) p = setParticleX(p, PARTICLE_X(p, dx) - length, dx);
+      *right = appendParticle(*right, p);
+    }
+
+    /* Fill the gap with the last particle */
+    b->p[i] = b->p[b->n - 1];
+    b->n -= 1;
+  }
+}
+
+/* Appends the particles of buffer "from" (sent by a neighbour) that
+   are in cells [firstCell, lastCell) to buffer "to", and the others,
+   that passed the domain, to buffer "pass" (on to the next domain) */
+struct particleBuffer receiveParticles(struct particleBuffer to, struct particleBuffer from,
+                                       struct particleBuffer *pass, int firstCell, int lastCell, double dx)
+{
+  long i;
+  int cell;
+
+  for (i=0; i<from.n; i++) {
+    cell = PARTICLE_CELL(from.p[i], dx);
+    if (cell >= firstCell && cell < lastCell) to = appendParticle(to, from.p[i]);
+    else *pass = appendParticle(*pass, from.p[i]);
+  }
+
+  return to;
+}
+
+/* Exchanges buffers a and b */
+static void swapBuffers(struct particleBuffer *a, struct particleBuffer *b)
+{
+  struct particleBuffer t = *a;
+
+  *a = *b;
+  *b = t;
+}
+
+/****************************************************************
+  Time step
+ ****************************************************************/
+
+/* One full time step in domain-decomposed mode, on the slices:
+   deposition, Poisson solve, E_x, push and migration.
+   Equivalent to fromParticlesToGrid + findEx_fromPotential +
+   moveParticle/checkPeriodic in the replicated mode.
+   Particles are added to the phase space histograms ph, if armed.
+   Bz is that of the grid (for slices that get wider guard points).
+ */
+void decomposedStep(struct domain *dom, struct phaseSpace *ph, double *Bz,
+                    struct parameters param, double dx)
+{
+  int d, nDomains, nCells, nIterations;
+  long passing;
+  double length, res;
+
+  nDomains = param.nDomains;
+  nCells = param.nGridPoints - 1;
+  length = param.gridEnd - param.gridStart;
+
+  fitGuards(dom, nDomains, Bz, nCells, param.dt, dx);
+
+  #pragma omp parallel private(d)
+  {
+    /* Deposition to the slices */
+    #pragma omp for schedule(static,1)
+    for (d=0; d<nDomains; d++) {
+      depositSpecies(dom[d].n_i, dom[d].J_i, dom[d].ions, &dom[d], dx,
+                     phaseSpaceBins(ph, d, 0), ph, 0);
+      depositSpecies(dom[d].n_e, dom[d].J_e, dom[d].electrons, &dom[d], dx,
+                     phaseSpaceBins(ph, d, 1), ph, 1);
+    }
+
+    /* Guard point exchange */
+    #pragma omp for schedule(static,1)
+    for (d=0; d<nDomains; d++) {
+      reduceGuards(dom, d, nDomains, nCells, dx);
+    }
+
+    /* Potential */
+    poissonDecomposed(dom, nDomains, param.nGridPoints, dx, &res, &nIterations);
+
+    /* Electric field, and its guard points */
+    #pragma omp for schedule(static,1)
+    for (d=0; d<nDomains; d++) {
+      domainFindEx(&dom[d], dx);
+    }
+    #pragma omp for schedule(static,1)
+    for (d=0; d<nDomains; d++) {
+      exchangeGuards(dom, d, nDomains, nCells, 1);
+    }
+
+    /* Push, then send leaving particles */
+    #pragma omp for schedule(static,1)
+    for (d=0; d<nDomains; d++) {
+      dom[d].maxSpeed = 0;
+      dom[d].ions = pushSpecies(dom[d].ions, moveIon, &dom[d].f, dx, param.dt, &dom[d].maxSpeed);
+      dom[d].electrons = pushSpecies(dom[d].electrons, moveElectron, &dom[d].f, dx, param.dt,
+                                     &dom[d].maxSpeed);
+
+      sendParticles(&dom[d].ions, &dom[d].ionsLeft, &dom[d].ionsRight,
+                    dom[d].firstCell, dom[d].lastCell, nCells, length, dx);
+      sendParticles(&dom[d].electrons, &dom[d].electronsLeft, &dom[d].electronsRight,
+                    dom[d].firstCell, dom[d].lastCell, nCells, length, dx);
+    }
+
+    /* Receive from neighbours. Particles that passed the domain go
+       on in the same direction, until all have arrived. */
+    do {
+      #pragma omp for schedule(static,1)
+      for (d=0; d<nDomains; d++) {
+        struct domain *s = &dom[d];
+        int left = (d - 1 + nDomains)%nDomains;
+        int right = (d + 1)%nDomains;
+
+        s->ionsPassLeft.n = s->ionsPassRight.n = 0;
+        s->electronsPassLeft.n = s->electronsPassRight.n = 0;
+        s->ions = receiveParticles(s->ions, dom[left].ionsRight, &s->ionsPassRight,
+                                   s->firstCell, s->lastCell, dx);
+        s->ions = receiveParticles(s->ions, dom[right].ionsLeft, &s->ionsPassLeft,
+                                   s->firstCell, s->lastCell, dx);
+        s->electrons = receiveParticles(s->electrons, dom[left].electronsRight, &s->electronsPassRight,
+                                        s->firstCell, s->lastCell, dx);
+        s->electrons = receiveParticles(s->electrons, dom[right].electronsLeft, &s->electronsPassLeft,
+                                        s->firstCell, s->lastCell, dx);
+      }
+
+      /* Passing particles become the outgoing ones */
+      #pragma omp for schedule(static,1)
+      for (d=0; d<nDomains; d++) {
+        swapBuffers(&dom[d].ionsLeft, &dom[d].ionsPassLeft);
+        swapBuffers(&dom[d].ionsRight, &dom[d].ionsPassRight);
+        swapBuffers(&dom[d].electronsLeft, &dom[d].electronsPassLeft);
+        swapBuffers(&dom[d].electronsRight, &dom[d].electronsPassRight);
+      }
+
+      #pragma omp single
+      {
+        passing = 0;
+        for (d=0; d<nDomains; d++) {
+          passing += dom[d].ionsLeft.n + dom[d].ionsRight.n + dom[d].electronsLeft.n + dom[d].electronsRight.n;
+        }
+      }
+    } while (passing > 0);
+  }
+}
@@ -0,0 +1,71 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Energy Diagnostics
+ *** Kinetic and electrostatic field energy, used to check energy 
+ *** conservation (e.g. mixed vs double precision builds).
+ *******************************************************************/
+#include <stdlib.h>
+
+#include "../headers/structs.h"
+#include "../headers/definitions.h"
+#include "../headers/temperature.h"
+#include "../headers/species.h"
+
+/* Kinetic energy of a species: sum of (1/2) m v^2 w.
+   delta-f species (deltaF != 0): markers sample f_0, and carry 
+   weight delta_f/f_0, so every marker counts (1 + w) times.
+ */
+double kineticEnergy(struct particle *p, long number, double mass, int deltaF)
+{
+  long i;
+  double ek = 0;
+
+  for (i=0; i<number; i++) {
+    ek += (p[i].v.x*p[i].v.x + p[i].v.y*p[i].v.y)*(deltaF ? 1 + p[i].w : p[i].w);
+  }
+
+  return 0.5*mass*ek;
+}
+
+/* Field energy: integral of (1/2) E_0 E^2 over the domain.
+   The last grid point is the periodic image of the first,
+   so it is not counted.
+ */
+double fieldEnergy(struct vector2D *E, int nGridPoints, double dx)
+{
+  int i;
+  double ef = 0;
+
+  for (i=0; i<nGridPoints-1; i++) {
+    ef += E[i].x*E[i].x + E[i].y*E[i].y;
+  }
+
+  return 0.5*E_0*ef*dx;
+}
+
+/* Total energies of the simulation (either mode) */
+struct energy simulationEnergy(struct simulation *s)
+{
+  int d;
+  struct energy e;
+
+  if (s->param.nDomains > 0) {
+    e.ions = 0;
+    e.electrons = 0;
+    for (d=0; d<s->param.nDomains; d++) {
+      e.ions += kineticEnergy(s->dom[d].ions.p, s->dom[d].ions.n, ION_MASS, 0);
+      e.electrons += kineticEnergy(s->dom[d].electrons.p, s->dom[d].electrons.n, ELECTRON_MASS, 0);
+    }
+    e.others = 0;
+  }
+  else {
+    e.ions = kineticEnergy(s->ions, s->param.nIons, ION_MASS, 
+                           deltaF_vth2(s->param, s->param.T_i, ION_MASS) > 0);
+    e.electrons = kineticEnergy(s->electrons, s->param.nElectrons, ELECTRON_MASS,
+                                deltaF_vth2(s->param, s->param.T_e, ELECTRON_MASS) > 0);
+    e.others = speciesEnergy(s);
+  }
+
+  e.field = fieldEnergy(s->f->E, s->param.nGridPoints, s->dx);
+
+  return e;
+}
@@ -0,0 +1,170 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Ensemble Mode
+ *** Runs many independent parameter variants in one process.
+ *** Every member is an OpenMP task; the runtime's task pool hands
+ *** members to idle threads, and the most expensive members are
+ *** queued first so that the pool does not end on a long run.
+ *** Small members are batched: several run one after another in
+ *** one task, so that the pool gets tasks of comparable size
+ *** instead of a tail of tiny ones.
+ *** Threads and memory policy belong to the process: they are set
+ *** once, from the first member, before the members start.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/simulation.h"
+#include "../headers/memory.h"
+
+/* Members cheaper than this fraction of the work per thread are
+   batched, up to that much work per batch */
+#define BATCH_FRACTION 0.25
+
+/* Rough cost estimate of a member (time steps times work per step):
+   particle push plus Gauss-Seidel Poisson solve (~ size^2 per step). 
+ */
+double memberCost(struct parameters param)
+{
+  double steps = param.time/param.dt;
+  double particles = (double)param.nIons + param.nElectrons;
+  double grid = (double)param.nGridPoints;
+
+  return steps*(particles + grid*grid);
+}
+
+/* Comparison function for qsort: descending cost */
+struct costIndex {
+  double cost;
+  int index;
+};
+
+int compareCost(const void *a, const void *b)
+{
+  double ca = ((const struct costIndex *)a)->cost;
+  double cb = ((const struct costIndex *)b)->cost;
+
+  if (ca > cb) return -1;
+  if (ca < cb) return 1;
+  return 0;
+}
+
+/* Applies the settings shared by all members (threads, memory policy)
+   of the first member; members that ask for others use these too. */
+static void sharedSettings(struct parameters *members, int nMembers)
+{
+  int m;
+
+  for (m=1; m<nMembers; m++) {
+    if (members[m].nThreads != members[0].nThreads) {
+      printf("# Note: member %03d: threads are shared by all members (as member 000).\n", m);
+      members[m].nThreads = members[0].nThreads;
+    }
+    if (members[m].memoryPolicy != members[0].memoryPolicy) {
+      printf("# Note: member %03d: the memory policy is shared by all members (as member 000).\n", m);
+      members[m].memoryPolicy = members[0].memoryPolicy;
+    }
+  }
+
+  if (members[0].nThreads > 0) omp_set_num_threads(members[0].nThreads);
+  setMemoryPolicy(members[0].memoryPolicy);
+}
+
+/* Live metrics: member m serves them on <path>.<m> (e.g. pic.sock.003),
+   as every member has a socket of its own */
+static void memberMetricsPaths(struct parameters *members, int nMembers)
+{
+  char path[PATH_LENGTH];
+  int m;
+
+  for (m=0; m<nMembers; m++) {
+    if (members[m].metricsPath[0] == '\0') continue;
+    snprintf(path, PATH_LENGTH, "%s.%03d", members[m].metricsPath, m);
+    strcpy(members[m].metricsPath, path);
+  }
+}
+
+/* Groups the members (in "order", most expensive first) into batches:
+   batch b is order[batchStart[b]] ... order[batchStart[b+1]-1].
+   A member above the threshold is a batch of its own. 
+   Returns the number of batches.
+ */
+static int batchMembers(struct costIndex *order, int nMembers, int *batchStart)
+{
+  double total = 0, threshold, cost;
+  int k, nBatches = 0;
+
+  for (k=0; k<nMembers; k++) total += order[k].cost;
+  threshold = BATCH_FRACTION*total/omp_get_max_threads();
+
+  k = 0;
+  while (k < nMembers) {
+    batchStart[nBatches++] = k;
+    cost = order[k++].cost;
+    while (k < nMembers && cost + order[k].cost <= threshold) cost += order[k++].cost;
+  }
+  batchStart[nBatches] = nMembers;
+
+  return nBatches;
+}
+
+/* Runs member m */
+static void runMember(struct parameters *members, int m)
+{
+  char prefix[PATH_LENGTH];
+  struct simulation *s;
+  double time;
+
+  snprintf(prefix, PATH_LENGTH, "output/member%03d_", m);
+  s = setupSimulation(members[m], prefix);
+  time = runSimulation(s);
+  deAllocateSimulation(s); free(s);
+
+  printf("# member %03d: T_i %.3f T_e %.3f k %.2f ions %ld electrons %ld grid %d ... %f sec.\n",
+         m, members[m].T_i, members[m].T_e, members[m].k,
+         members[m].nIons, members[m].nElectrons, members[m].nGridPoints, time);
+}
+
+/* Runs all members of the ensemble. Member m writes its output
+   to output/member<m>_<name> (e.g. output/member003_rho1D.txt).
+   Returns total wall time in seconds.
+ */
+double runEnsemble(struct parameters *members, int nMembers)
+{
+  int k, b, nBatches, *batchStart;
+  double tStart;
+  struct costIndex *order;
+
+  /* Most expensive members first */
+  order = (struct costIndex *)malloc(nMembers * sizeof(struct costIndex));
+  for (k=0; k<nMembers; k++) {
+    order[k].cost = memberCost(members[k]);
+    order[k].index = k;
+  }
+  qsort(order, nMembers, sizeof(struct costIndex), compareCost);
+  sharedSettings(members, nMembers);
+  memberMetricsPaths(members, nMembers);
+
+  batchStart = (int *)malloc((nMembers + 1) * sizeof(int));
+  nBatches = batchMembers(order, nMembers, batchStart);
+
+  printf("\n################### PIC Ensemble (1d2v) #####################\n");
+  printf("# Members: %d (in %d tasks)\tThreads: %d\n", nMembers, nBatches, omp_get_max_threads());
+  printf("#############################################################\n");
+
+  tStart = omp_get_wtime();
+
+  #pragma omp parallel
+  #pragma omp single
+  for (b=0; b<nBatches; b++) {
+    #pragma omp task firstprivate(b) private(k)
+    for (k=batchStart[b]; k<batchStart[b+1]; k++) runMember(members, order[k].index);
+  }
+
+  free(batchStart);
+  free(order);
+
+  return omp_get_wtime() - tStart;
+}
@@ -0,0 +1,261 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Implicit (Crank-Nicolson) Time Step
+ ***
+ *** Energy-conserving implicit PIC (see Chen, Chacon, Barnes,
+ *** J. Comput. Phys. 230 (2011) 7018), electrostatic version:
+ ***   x^{n+1} = x^n + dt v^{n+1/2}
+ ***   v^{n+1} = v^n + dt (q/m) [E^{n+1/2}(x^{n+1/2}) + v^{n+1/2} x B]
+ ***   E^{n+1} = E^n - dt (J^{n+1/2} - <J^{n+1/2}>)      (Ampere)
+ *** with E^{n+1/2} = (E^n + E^{n+1})/2, and J^{n+1/2} deposited from
+ *** the half-step particles with the same shape as the gather, so
+ *** that the field energy lost equals the kinetic energy gained.
+ *** The nonlinear system for E^{n+1} is solved by Picard iteration
+ *** (each iteration: implicit half push of all particles, then
+ *** deposition of J), which converges for omega_p*dt up to ~1.
+ *** The step is stable for dt far larger than the explicit one.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../headers/structs.h"
+#include "../headers/memory.h"
+#include "../headers/setup.h"
+#include "../headers/shape.h"
+#include "../headers/interpolate.h"
+#include "../headers/definitions.h"
+
+#define MAX_PICARD_ITERATIONS 100
+#define MAX_PARTICLE_ITERATIONS 20
+/* Picard iteration is diverging when the change in E grows by this factor */
+#define MAX_DIVERGENCE 1e3
+/* Maximum number of times a step may be split in two */
+#define MAX_SPLIT 10
+
+/* Allocates work arrays of the implicit step.
+   The half step particles start as copies of the initial particles
+   (first guess of the first step).
+ */
+struct implicitState * allocateImplicit(struct particle *ions, struct particle *electrons,
+                                        struct parameters param)
+{
+  long i;
+  struct implicitState *im = (struct implicitState *)malloc( sizeof(struct implicitState) );
+
+  im->ionsHalf = allocateParticles(param.nIons);
+  im->electronsHalf = allocateParticles(param.nElectrons);
+  im->E_old = (struct vector2D *)malloc(param.nGridPoints * sizeof(struct vector2D));
+  im->E_half = (struct vector2D *)malloc(param.nGridPoints * sizeof(struct vector2D));
+  im->nIterations = 0;
+
+  for (i=0; i<param.nIons; i++) im->ionsHalf[i] = ions[i];
+  for (i=0; i<param.nElectrons; i++) im->electronsHalf[i] = electrons[i];
+
+  return im;
+}
+
+/* Implicit State De-Allocator */
+void deAllocateImplicit(struct implicitState *im)
+{
+  deAllocateParticles(im->ionsHalf); deAllocateParticles(im->electronsHalf);
+  free(im->E_old); free(im->E_half);
+}
+
+/* Maps x back into the periodic domain [left, right).
+   Unlike checkPeriodic, it also works for particles that move more than
+   one period (large dt, or early Picard iterations).
+ */
+static inline double wrapPosition(double x, double left, double right)
+{
+  double length = right - left;
+
+  return x - length*floor((x - left)/length);
+}
+
+/* Implicit half step of one particle:
+   solves v_h = v + (dt/2)(q/m) F(x + (dt/2) v_h, v_h) by fixed point
+   iteration, starting from the previous guess in "half".
+   Returns the particle at the half step (position wrapped periodically,
+   so that it can be deposited).
+ */
+struct particle halfPush(struct particle p, struct particle half, double charge, double mass,
+                         struct field *fHalf, struct parameters param, double dx)
+{
+  int k;
+  double x, xh, vx, vy, h;
+  struct vector2D F;
+
+  h = 0.5*param.dt;
+  x = PARTICLE_X(p, dx);
+  vx = half.v.x;
+  vy = half.v.y;
+
+  for (k=0; k<MAX_PARTICLE_ITERATIONS; k++) {
+    double vxOld = vx, vyOld = vy;
+
+    xh = wrapPosition(x + h*vx, param.gridStart, param.gridEnd);
+    F = particleF(xh, vx, vy, charge, fHalf, dx);
+    vx = p.v.x + h*F.x/mass;
+    vy = p.v.y + h*F.y/mass;
+
+    if (fabs(vx - vxOld) + fabs(vy - vyOld) <= 1e-14*(fabs(vx) + fabs(vy) + 1e-300)) break;
+  }
+
+  half = p;
+  half.v.x = vx;
+  half.v.y = vy;
+  half = setParticleX(half, wrapPosition(x + h*vx, param.gridStart, param.gridEnd), dx);
+
+  return half;
+}
+
+/* Half pushes a whole species */
+void halfPushSpecies(struct particle *p, struct particle *half, long number, double charge, double mass,
+                     struct field *fHalf, struct parameters param, double dx)
+{
+  long i;
+
+  #pragma omp parallel for schedule(static)
+  for (i=0; i<number; i++) {
+    half[i] = halfPush(p[i], half[i], charge, mass, fHalf, param, dx);
+  }
+}
+
+/* Completes the step from the converged half step:
+   x^{n+1} = x^n + dt v_h,  v^{n+1} = 2 v_h - v^n
+ */
+void finishSpecies(struct particle *p, struct particle *half, long number,
+                   struct parameters param, double dx)
+{
+  long i;
+  double x;
+
+  #pragma omp parallel for schedule(static) private(x)
+  for (i=0; i<number; i++) {
+    x = PARTICLE_X(p[i], dx) + param.dt*half[i].v.x;
+#ifndef MIXED_PRECISION
+    p[i].r.y += param.dt*half[i].v.y;
+#endif
+    p[i].v.x = 2*half[i].v.x - p[i].v.x;
+    p[i].v.y = 2*half[i].v.y - p[i].v.y;
+    p[i] = setParticleX(p[i], wrapPosition(x, param.gridStart, param.gridEnd), dx);
+  }
+}
+
+/* Picard iteration for E^{n+1} (held in f->E; E^n in im->E_old).
+   Returns number of iterations, or 0 if the iteration did not converge
+   (dt too large: it then diverges, see MAX_DIVERGENCE).
+ */
+static int picardSolve(struct implicitState *im, struct particle *ions, struct particle *electrons,
+                       struct grid *g, struct field *f, struct parameters param, double dx)
+{
+  int i, it, size;
+  double meanJ, change, firstChange, norm;
+  struct field fHalf;
+
+  size = param.nGridPoints;
+
+  /* Field at the half step, with the same (static) Bz */
+  fHalf.E = im->E_half;
+  fHalf.Bz = f->Bz;
+  fHalf.nGridPoints = size;
+  fHalf.open = f->open;
+  fHalf.slice = 0;
+  fHalf.firstPoint = 0;
+
+  firstChange = 0;
+  for (it=1; it<=MAX_PICARD_ITERATIONS; it++) {
+    for (i=0; i<size; i++) {
+      im->E_half[i].x = 0.5*(im->E_old[i].x + f->E[i].x);
+      im->E_half[i].y = 0.5*(im->E_old[i].y + f->E[i].y);
+    }
+
+    /* Particles at the half step */
+    halfPushSpecies(ions, im->ionsHalf, param.nIons, ION_CHARGE, ION_MASS, &fHalf, param, dx);
+    halfPushSpecies(electrons, im->electronsHalf, param.nElectrons, ELECTRON_CHARGE, ELECTRON_MASS,
+                    &fHalf, param, dx);
+
+    /* Current at the half step */
+    g->J = interpolateJ(g, im->ionsHalf, im->electronsHalf, param, dx);
+
+    /* Ampere's law (periodic: the mean current does not change E) */
+    meanJ = 0;
+    for (i=0; i<size-1; i++) meanJ += g->J[i].x;
+    meanJ /= (size - 1);
+
+    change = 0;
+    norm = 0;
+    for (i=0; i<size; i++) {
+      double E_new = im->E_old[i].x - param.dt*(g->J[i].x - meanJ);
+      change = fmax(change, fabs(E_new - f->E[i].x));
+      norm = fmax(norm, fabs(E_new));
+      f->E[i].x = E_new;
+    }
+
+    if (change <= param.implicitTolerance*(norm + 1e-300)) return it;
+
+    /* Diverging: stop before the particles run away */
+    if (it == 1) firstChange = change;
+    if (!isfinite(change) || change > MAX_DIVERGENCE*firstChange) return 0;
+  }
+
+  return 0;
+}
+
+/* Implicit step of size param.dt. If the Picard iteration fails, the
+   step is split into two steps of dt/2 (at most MAX_SPLIT times deep),
+   so a too large dt costs time but does not ruin the run.
+   Returns total number of Picard iterations.
+ */
+static int splitStep(struct implicitState *im, struct particle *ions, struct particle *electrons,
+                     struct grid *g, struct field *f, struct parameters param, double dx, int depth)
+{
+  long i;
+  int it;
+
+  /* Old field. f->E holds the current guess for E^{n+1} */
+  for (i=0; i<param.nGridPoints; i++) im->E_old[i] = f->E[i];
+
+  it = picardSolve(im, ions, electrons, g, f, param, dx);
+
+  if (it == 0 && depth < MAX_SPLIT) {
+    /* Start over, with two half steps */
+    for (i=0; i<param.nGridPoints; i++) f->E[i] = im->E_old[i];
+    for (i=0; i<param.nIons; i++) im->ionsHalf[i] = ions[i];
+    for (i=0; i<param.nElectrons; i++) im->electronsHalf[i] = electrons[i];
+
+    param.dt *= 0.5;
+    it = splitStep(im, ions, electrons, g, f, param, dx, depth + 1);
+    it += splitStep(im, ions, electrons, g, f, param, dx, depth + 1);
+
+    return it;
+  }
+
+  if (it == 0) {
+    printf("\n*****************************************\n");
+    printf("Warning: Implicit step did not converge (dt = %e)!\n", param.dt);
+    printf("*****************************************\n\n");
+    it = MAX_PICARD_ITERATIONS;
+  }
+
+  /* New particles, and charge density at the new time */
+  finishSpecies(ions, im->ionsHalf, param.nIons, param, dx);
+  finishSpecies(electrons, im->electronsHalf, param.nElectrons, param, dx);
+  g->rho = interpolateRho(g, ions, electrons, param, dx);
+
+  return it;
+}
+
+/* One implicit time step. Updates particles, f->E, and the grid
+   quantities n_i, n_e, rho (at the new time) and J (at the half step).
+   The potential u is not needed by the step; it is found only
+   for output (see runSimulation).
+   Returns number of Picard iterations (also kept in im->nIterations).
+ */
+int implicitStep(struct implicitState *im, struct particle *ions, struct particle *electrons,
+                 struct grid *g, struct field *f, struct parameters param, double dx)
+{
+  im->nIterations = splitStep(im, ions, electrons, g, f, param, dx, 0);
+
+  return im->nIterations;
+}
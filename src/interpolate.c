@@ -1,7 +1,8 @@
 /**************************************************************************
  **** PIC - 1d2v electromagnetic
- **** This file contains functions that interpolate particle data to cells
- **** and grid data to particles.
+ **** This file contains functions that interpolate particle data to cells.
+ **** The particle shape (and the interpolation from grid data to particles)
+ **** is in headers/shape.h.
  **************************************************************************/
 
 #include <stdio.h> //for testing purposes!
@@ -9,87 +10,25 @@
 
 #include "../headers/structs.h"
 #include "../headers/definitions.h"
-
-/****************************************************************
-  From grid to particles:
- ****************************************************************/
-/* Function that returns the electric field 
-   at given particle's position x. It employs CIC
-   interpolation.
-*/ 
-struct vector2D particleE (double x, struct vector2D *E, double dx)
-{
-  int cell;
-  struct vector2D pE;
-
-  /* Find cell index of particle */
-  cell = (int)floor(x/dx);
-
-  /* Interpolate fields from neighboring cells */
-  pE.x = ( x - cell*dx ) * E[cell+1].x / dx;
-  pE.x += ( (cell+1)*dx - x ) * E[cell].x / dx;
-
-  pE.y = ( x - cell*dx ) * E[cell+1].y / dx;
-  pE.y += ( (cell+1)*dx - x ) * E[cell].y / dx;
-
-  return pE;
-}
-
-/* Function that returns the magnetic field Bz
-   at given particle's position x. It employs CIC
-   interpolation.
-*/ 
-double particleBz (double x, double *B, double dx)
-{
-  int cell;
-  double pB;
-
-  /* Find cell index of particle */
-  cell = (int)floor(x/dx);
-
-  /* Interpolate fields from neighboring cells */
-  pB = ( x - cell*dx ) * B[cell+1] / dx;
-  pB += ( (cell+1)*dx - x ) * B[cell] / dx;
-
-  return pB;
-}
-
-/* Returns force on given particle.
-   Arguments were chosen to satisfy the Runge-Kutta method,
-   which relies on incrementing position and velocities on each stage.
-*/
-struct vector2D particleF(double x, double v_x, double v_y, double particleCharge,
-			  struct vector2D *E, double *Bz, double dx)
-{
-  struct vector2D pE, F;
-  double pBz;
-  
-  /* Interpolate fields to particle */
-  pE = particleE(x, E, dx);
-  pBz = particleBz(x, Bz, dx);
-
-  /* Calculate force on particle: F = q * [E + (v x B) ]
-     The cross product in this 1D version was implemented by hand
-     (see the signs). 
-  */
-  F.x = particleCharge*(pE.x + v_y*pBz);
-  F.y = particleCharge*(pE.y - v_x*pBz);
-
-  return F;
-}
+#include "../headers/shape.h"
+#include "../headers/temperature.h"
+#include "../headers/phasespace.h"
 
 /****************************************************************
   From particles to grid:
  ****************************************************************/
 
-/* Cloud-In-Cell interpolation (from particle positions to number density).
-   First order interpolation - Returns n_(i or e) array
+/* Interpolation from particle positions to number density, with the
+   particle shape set by SHAPE_ORDER (NGP, CIC or TSC; see shape.h).
+   Returns n_(i or e) array
    See Birdsall - Langdon, Part 1, ch.2-6
 */
-double * nCIC (double *n, struct particle *p, 
-		 double dx, int particleNumber, int nGrid)
+double * nShape (double *n, struct particle *p, 
+		 double dx, long particleNumber, int nGrid)
 {
-  int i, cell;
+  long i;
+  int k, cell, first;
+  double x, w[SHAPE_POINTS];
 
   /* Zero previous calculation */
   for (i=0; i<nGrid; i++) {
@@ -99,18 +38,21 @@ double * nCIC (double *n, struct particle *p,
   /* Go through all particles in given species */
   for (i=0; i<particleNumber; i++) {
     //Find cell index of particle
-    cell = (int)floor(p[i].r.x/dx);
+    cell = PARTICLE_CELL(p[i], dx);
+    x = PARTICLE_X(p[i], dx);
 
     /* FOR TESTING - DEBUGGING PURPOSES: */
     //if(cell < 0) printf("\n*** particle %d, cell index < 0 !!! ***\n", i);
     //if(cell >= nGrid) printf("\n*** particle %d, cell index > nGrid !!! ***\n", i);  
 
-    /* Interpolate charge to neighboring cells 
+    /* Interpolate charge to neighboring points 
 	This is equivalent to counting (but also interpolating)
 	At the end n[cell] can be considered as "number of particles in cell"
     */
-    n[cell] += ( (cell+1)*dx - p[i].r.x )/dx; 
-    n[cell+1] += (p[i].r.x - cell*dx)/dx; 
+    first = shapeWeights(x, cell, dx, w);
+    for (k=0; k<SHAPE_POINTS; k++) {
+      n[wrapPoint(first + k, nGrid)] += w[k]*p[i].w/dx;
+    }
   }
 
   /* Calculate actual density by dividing number of particles in cell by dx */
@@ -130,6 +72,32 @@ double * nCIC (double *n, struct particle *p,
   return n;
 }
 
+/* delta-f mode: adds the (uniform) density of the Maxwellian background f_0
+   to the perturbation density found by nShape. The background carries 
+   no current, so J needs no correction.
+   The number of particles is conserved, so the mean of the perturbation 
+   must vanish: its sampling noise is removed here (otherwise the net 
+   charge feeds back on itself through the potential boundary conditions).
+ */
+double * addBackgroundDensity (double *n, long particleNumber, int nGrid, double length)
+{
+  int i;
+  double n0 = particleNumber/length;
+  double mean = 0;
+
+  /* Last grid point is the periodic image of the first */
+  for (i=0; i<nGrid-1; i++) {
+    mean += n[i];
+  }
+  mean /= (nGrid - 1);
+
+  for (i=0; i<nGrid; i++) {
+    n[i] += n0 - mean;
+  }
+
+  return n;
+}
+
 /*
    Finds rho (charge density) from particle positions (interpolation). 
    Also updates n_i, n_e.
@@ -142,10 +110,18 @@ double * interpolateRho (struct grid * g,
   int i;
 
   /* Interpolation from ions to n_i density */
-  g->n_i = nCIC(g->n_i, ions, dx, param.nIons, param.nGridPoints);
+  g->n_i = nShape(g->n_i, ions, dx, param.nIons, param.nGridPoints);
 
   /* Interpolation from electrons to n_e density */
-  g->n_e = nCIC(g->n_e, electrons, dx, param.nElectrons, param.nGridPoints);
+  g->n_e = nShape(g->n_e, electrons, dx, param.nElectrons, param.nGridPoints);
+
+  /* delta-f mode: particles carry only the perturbation */
+  if (deltaF_vth2(param, param.T_i, ION_MASS) > 0) {
+    g->n_i = addBackgroundDensity(g->n_i, param.nIons, param.nGridPoints, param.gridEnd - param.gridStart);
+  }
+  if (deltaF_vth2(param, param.T_e, ELECTRON_MASS) > 0) {
+    g->n_e = addBackgroundDensity(g->n_e, param.nElectrons, param.nGridPoints, param.gridEnd - param.gridStart);
+  }
 
   /* Calculate charge density */
   for (i=0; i<param.nGridPoints; i++) {
@@ -159,11 +135,17 @@ double * interpolateRho (struct grid * g,
  J (current density) interpolation
  ******************************************************/
 
-/* Interpolates current density J for one species */
-struct vector2D * jCIC(struct vector2D *j, struct particle *p, 
-            double dx, int particleNumber, int nGrid) 
+/* Interpolates current density J for one species (shape as in nShape).
+   If h is not NULL, the same sweep adds the particles to phase space
+   histogram h (see phasespace.c).
+ */
+struct vector2D * jShape(struct vector2D *j, struct particle *p, 
+            double dx, long particleNumber, int nGrid,
+            double *h, struct phaseSpace *ph, int species) 
 {
-  int i, cell;
+  long i;
+  int k, cell, first, point;
+  double x, w[SHAPE_POINTS];
 
   /* Zero previous calculation */
   for (i=0; i<nGrid; i++) {
@@ -174,21 +156,25 @@ struct vector2D * jCIC(struct vector2D *j, struct particle *p,
   /* Go through all particles in given species */
   for (i=0; i<particleNumber; i++) {
     //Find cell index of particle
-    cell = (int)floor(p[i].r.x/dx);
+    cell = PARTICLE_CELL(p[i], dx);
+    x = PARTICLE_X(p[i], dx);
 
     /* TEST - DEBUG - REMOVE */
     //if(cell < 0) printf("\n*** particle %d, charge %f: cell index < 0 !!! ***\n", i, p[i].q);
     //if(cell >= nGrid) printf("\n*** particle %d, charge %f: cell index > nGrid !!! ***\n", i, p[i].q);  
 
-    /* Interpolate charge & velocity to neighboring cells 
+    /* Interpolate charge & velocity to neighboring points 
 	This is equivalent to counting (but also interpolating)
 	At the end j[cell] can be considered as "number of particles in cell times velocity"
     */
-    j[cell].x += ( (cell+1)*dx - p[i].r.x )*p[i].v.x/dx; 
-    j[cell+1].x += (p[i].r.x - cell*dx)*p[i].v.x/dx; 
-
-    j[cell].y += ( (cell+1)*dx - p[i].r.x )*p[i].v.y/dx; 
-    j[cell+1].y += (p[i].r.x - cell*dx)*p[i].v.y/dx; 
+    first = shapeWeights(x, cell, dx, w);
+    for (k=0; k<SHAPE_POINTS; k++) {
+      point = wrapPoint(first + k, nGrid);
+      j[point].x += w[k]*p[i].w*p[i].v.x/dx; 
+      j[point].y += w[k]*p[i].w*p[i].v.y/dx; 
+    }
+
+    if (h != NULL) addToPhaseSpace(h, ph, species, x, p[i].v.x, p[i].w);
   }
 
   /* Force periodic boundaries for particles
@@ -210,7 +196,7 @@ struct vector2D * jCIC(struct vector2D *j, struct particle *p,
   return j;
 }
 
-/* Calculates Current Density J for both species, by calling jCIC */
+/* Calculates Current Density J for both species, by calling jShape */
 struct vector2D * interpolateJ (struct grid * g, struct particle * ions, struct particle * electrons, 
 		       struct parameters param, double dx) 
 {
@@ -223,10 +209,12 @@ struct vector2D * interpolateJ (struct grid * g, struct particle * ions, struct
   }
 
   /* Interpolation from ions to j_i density */
-  g->J_i = jCIC(g->J_i, ions, dx, param.nIons, param.nGridPoints);
+  g->J_i = jShape(g->J_i, ions, dx, param.nIons, param.nGridPoints,
+                  phaseSpaceBins(g->phase, 0, 0), g->phase, 0);
 
   /* Interpolation from electrons to j_e density */
-  g->J_e = jCIC(g->J_e, electrons, dx, param.nElectrons, param.nGridPoints);
+  g->J_e = jShape(g->J_e, electrons, dx, param.nElectrons, param.nGridPoints,
+                  phaseSpaceBins(g->phase, 0, 1), g->phase, 1);
 
   /* Calculate charge density */
   for (i=0; i<param.nGridPoints; i++) {
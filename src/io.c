@@ -5,27 +5,288 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include "../headers/structs.h"
 
-#define BUF_LENGTH 100
+/* Longest line of the input files (a G line of 32 points, a path of
+   PATH_LENGTH characters, with room to spare) */
+#define BUF_LENGTH 1024
 
 /* Prints problem parameters to the screen, at the 
    beginning of the program.
  */
 void printParameters (struct parameters param, int totalTimeSteps, double dx) 
 {
+  int k;
+
   printf("\n################### PIC Simulation (1d2v) ###################\n");
   printf("# Parameters: \n");
   printf("# \t\tTotal time: %.2f\tdt: %f\n", param.time, param.dt);
   printf("# \t\t(%d timesteps, output every %d steps)\n#\n", totalTimeSteps, param.interval);
-  printf("# \t\tNumber of ions: \t%d\n#\t\tNumber of electrons: \t%d\n#\n", param.nIons, param.nElectrons);
+  printf("# \t\tNumber of ions: \t%ld\n#\t\tNumber of electrons: \t%ld\n#\n", param.nIons, param.nElectrons);
   printf("# \t\tIon T: \t\t\t%.3f\n#\t\tElectron T: \t\t%.3f\n#\t\tk: \t\t\t%.2f\n", param.T_i, param.T_e, param.k);
   printf("# \t\tGrid Points: \t\t%d\n#\t\tCell size (dx): \t%f\n#", param.nGridPoints, dx);
+  if (param.nDomains > 0) printf("\n# \t\tDomains: \t\t%d\n#", param.nDomains);
+  if (param.deltaF) printf("\n# \t\tdelta-f mode (species with T > 0)\n#");
+  if (param.implicit) printf("\n# \t\tImplicit time step (tolerance %.1e)\n#", param.implicitTolerance);
+  if (param.resampleInterval > 0) printf("\n# \t\tResampling every %d steps\n#", param.resampleInterval);
+  if (param.outOfCore) printf("\n# \t\tOut-of-core particles (chunks of %d)\n#", param.chunkSize);
+  for (k=0; k<param.nSpecies; k++) {
+    printf("\n# \t\tSpecies %s: %ld particles, q %.3f, m %.3f, w %.3f, T %.3f, drift %.3f, %s",
+           param.species[k].name, param.species[k].number, param.species[k].charge,
+           param.species[k].mass, param.species[k].weight, param.species[k].T,
+           param.species[k].drift, param.species[k].pusher == 1 ? "Boris" : "RK4");
+    if (param.species[k].subcycle > 1) printf(", every %d steps", param.species[k].subcycle);
+    printf("\n#");
+  }
+  if (param.quietStart) {
+    printf("\n# \t\tQuiet start%s\n#", param.quietMirror ? " (mirrored velocity pairs)" : "");
+  }
+  if (param.memoryPolicy > 0) printf("\n# \t\tMemory policy: \t\t%d\n#", param.memoryPolicy);
+  if (param.streamTarget[0] != '\0') {
+    printf("\n# \t\tStreaming to %s (%d variables%s)\n#", param.streamTarget,
+           param.nStreamVariables, param.textOutput ? "" : ", no text output of the grid");
+  }
+  if (param.openBoundaries) {
+    printf("\n# \t\tOpen boundaries (%s)\n#", param.injection ? "absorbing, injecting" : "absorbing");
+  }
+  if (param.nThreads > 0) printf("\n# \t\tThreads: \t\t%d\n#", param.nThreads);
+  if (param.sortInterval > 0) printf("\n# \t\tSorting particles every %d steps\n#", param.sortInterval);
+  if (param.snapshotMode == 1) printf("\n# \t\tCompressed snapshots (lossless)\n#");
+  if (param.snapshotMode == 2) {
+    printf("\n# \t\tCompressed snapshots (tolerance %.1e)\n#", param.snapshotTolerance);
+  }
+  if (param.adaptiveOutput) {
+    printf("\n# \t\tAdaptive output: every %d to %d steps (change %.3f)\n#", param.minInterval,
+           param.maxInterval, param.outputThreshold);
+  }
+  if (param.metricsPath[0] != '\0') printf("\n# \t\tLive metrics on %s\n#", param.metricsPath);
+  if (param.profile) printf("\n# \t\tProfiling (counters per phase)\n#");
+  if (param.nProbes > 0) printf("\n# \t\tProbes: \t\t%d (every step)\n#", param.nProbes);
+  if (param.phaseEvery > 0) {
+    printf("\n# \t\tPhase space: %d x %d bins, every %d outputs\n#", 
+           param.phaseNx, param.phaseNv, param.phaseEvery);
+  }
   printf("\n#############################################################\n");
 }
 
 
-/* Gets parameters from single line of file input */
+/* Reads a single line of file input into the parameter structure.
+   Lines that do not start with a known letter are ignored.
+ */
+struct parameters parseParameterLine(struct parameters p, char *buf)
+{
+  /* If scanning Time Parameters */
+  if (buf[0] == 'T'){
+    sscanf(buf, "%c %lf %lf %d", &buf[0], &p.time, &p.dt, &p.interval);
+  }
+  /* If scanning Particle Parameters */
+  else if (buf[0] == 'P'){
+    sscanf(buf, "%c %ld %ld", &buf[0], &p.nIons, &p.nElectrons);
+  }
+  /* If scanning Space Parameters */
+  else if (buf[0] == 'S'){
+    sscanf(buf, "%c %d %lf %lf", &buf[0], &p.nGridPoints, &p.gridStart, &p.gridEnd);
+  }
+  /* If scanning Other Parameters */
+  else if (buf[0] == 'O'){
+    sscanf(buf, "%c %lf %lf %lf", &buf[0], &p.T_i, &p.T_e, &p.k);
+  }
+  /* If scanning Domain decomposition Parameters */
+  else if (buf[0] == 'D'){
+    sscanf(buf, "%c %d", &buf[0], &p.nDomains);
+  }
+  /* If scanning delta-f Parameters */
+  else if (buf[0] == 'F'){
+    sscanf(buf, "%c %d", &buf[0], &p.deltaF);
+  }
+  /* If scanning Implicit time step Parameters */
+  else if (buf[0] == 'I'){
+    sscanf(buf, "%c %d %lf", &buf[0], &p.implicit, &p.implicitTolerance);
+  }
+  /* If scanning Resampling Parameters */
+  else if (buf[0] == 'R'){
+    sscanf(buf, "%c %d %d", &buf[0], &p.resampleInterval, &p.resampleTarget);
+  }
+  /* If scanning Memory (out-of-core) Parameters */
+  else if (buf[0] == 'M'){
+    sscanf(buf, "%c %d %d", &buf[0], &p.outOfCore, &p.chunkSize);
+  }
+  /* If scanning Huge page / NUMA Parameters */
+  else if (buf[0] == 'H'){
+    sscanf(buf, "%c %d %d", &buf[0], &p.memoryPolicy, &p.memoryReport);
+  }
+  /* If scanning Quiet start Parameters */
+  else if (buf[0] == 'Q'){
+    sscanf(buf, "%c %d %d", &buf[0], &p.quietStart, &p.quietMirror);
+  }
+  /* If scanning Streaming output Parameters ("-": off) */
+  else if (buf[0] == 'W'){
+    sscanf(buf, "%c %255s %d", &buf[0], p.streamTarget, &p.textOutput);
+    if (strcmp(p.streamTarget, "-") == 0) p.streamTarget[0] = '\0';
+  }
+  /* If scanning phase space (X-V) histogram Parameters */
+  else if (buf[0] == 'X'){
+    sscanf(buf, "%c %d %d %d %lf %lf", &buf[0], &p.phaseEvery, &p.phaseNx, &p.phaseNv,
+           &p.phaseVMax_i, &p.phaseVMax_e);
+  }
+  /* If scanning probe (Gauge) Parameters: block size, then grid points */
+  else if (buf[0] == 'G'){
+    char *c, *end;
+
+    p.probeBlock = (int)strtol(buf + 1, &end, 10);
+    for (p.nProbes=0; p.nProbes<MAX_PROBES; p.nProbes++) {
+      p.probePoints[p.nProbes] = (int)strtol(end, &c, 10);
+      if (c == end) break;
+      end = c;
+    }
+  }
+  /* If scanning particle Boundary Parameters */
+  else if (buf[0] == 'B'){
+    sscanf(buf, "%c %d %d %lf %lf", &buf[0], &p.openBoundaries, &p.injection,
+           &p.driftIons, &p.driftElectrons);
+  }
+  /* If scanning Autotuning Parameters */
+  else if (buf[0] == 'A'){
+    sscanf(buf, "%c %d %d %d %d", &buf[0], &p.autotune, &p.tuneSteps, &p.nThreads, &p.sortInterval);
+  }
+  /* If scanning compressed snapshot (Zip) Parameters */
+  else if (buf[0] == 'Z'){
+    sscanf(buf, "%c %d %lf", &buf[0], &p.snapshotMode, &p.snapshotTolerance);
+  }
+  /* If scanning adaptive output (Update cadence) Parameters */
+  else if (buf[0] == 'U'){
+    sscanf(buf, "%c %d %d %d %lf", &buf[0], &p.adaptiveOutput, &p.minInterval, &p.maxInterval,
+           &p.outputThreshold);
+  }
+  /* If scanning Live metrics Parameters */
+  else if (buf[0] == 'L'){
+    sscanf(buf, "%c %255s", &buf[0], p.metricsPath);
+    if (strcmp(p.metricsPath, "-") == 0) p.metricsPath[0] = '\0';
+  }
+  /* If scanning profiling (Counter) Parameters */
+  else if (buf[0] == 'C'){
+    sscanf(buf, "%c %d %lf %lf", &buf[0], &p.profile, &p.profilePeak, &p.profileBandwidth);
+  }
+  /* If scanning an additional species (name, number, charge, mass, weight,
+     T, drift, pusher, subcycle) */
+  else if (buf[0] == 'K' && p.nSpecies < MAX_SPECIES){
+    struct species sp = {"", 0, -1.0, 1.0, 1.0, 0.0, 0.0, 0, 1};
+
+    if (sscanf(buf, "%c %7s %ld %lf %lf %lf %lf %lf %d %d", &buf[0], sp.name, &sp.number,
+               &sp.charge, &sp.mass, &sp.weight, &sp.T, &sp.drift, &sp.pusher, &sp.subcycle) >= 5) {
+      p.species[p.nSpecies++] = sp;
+    }
+  }
+  /* If scanning a streamed Variable (name, every, stride, bins) */
+  else if (buf[0] == 'V' && p.nStreamVariables < MAX_STREAM_VARIABLES){
+    struct streamVariable v = {"", 1, 1, 0};
+
+    if (sscanf(buf, "%c %7s %d %d %d", &buf[0], v.name, &v.every, &v.stride, &v.bins) >= 2) {
+      p.streamVariables[p.nStreamVariables++] = v;
+    }
+  }
+
+  return p;
+}
+
+/* Returns parameters with the default values of the optional
+   parameters (the others must be given, see input.txt) */
+struct parameters defaultParameters() {
+
+  struct parameters p = {0};
+
+  p.nDomains = 0;
+  p.deltaF = 0;
+  p.implicit = 0;
+  p.implicitTolerance = 1e-10;
+  p.resampleInterval = 0;
+  p.resampleTarget = 0;
+  p.outOfCore = 0;
+  p.chunkSize = 1048576;
+  p.memoryPolicy = 0;
+  p.memoryReport = 0;
+  p.nSpecies = 0;
+  p.quietStart = 0;
+  p.quietMirror = 0;
+  p.streamTarget[0] = '\0';
+  p.textOutput = 1;
+  p.nStreamVariables = 0;
+  p.phaseEvery = 0;
+  p.phaseNx = 64;
+  p.phaseNv = 64;
+  p.phaseVMax_i = 1.0;
+  p.phaseVMax_e = 1.0;
+  p.nProbes = 0;
+  p.probeBlock = 4096;
+  p.openBoundaries = 0;
+  p.injection = 0;
+  p.driftIons = 0;
+  p.driftElectrons = 0;
+  p.autotune = 0;
+  p.tuneSteps = 5;
+  p.nThreads = 0;
+  p.sortInterval = 0;
+  p.snapshotMode = 0;
+  p.snapshotTolerance = 0;
+  p.adaptiveOutput = 0;
+  p.minInterval = 1;
+  p.maxInterval = 0;
+  p.outputThreshold = 0.05;
+  p.metricsPath[0] = '\0';
+  p.profile = 0;
+  p.profilePeak = 0;
+  p.profileBandwidth = 0;
+
+  return p;
+}
+
+/* Reads one line of "file" into buf (BUF_LENGTH characters). A longer
+   line is cut, with a note, and the rest of it skipped (it is not
+   read as a line of its own). Returns 0 at the end of the file.
+ */
+static int readLine(FILE *file, char *buf)
+{
+  int c;
+  size_t n;
+
+  if (fgets(buf, BUF_LENGTH, file) == NULL) return 0;
+
+  n = strlen(buf);
+  if (n == BUF_LENGTH - 1 && buf[n - 1] != '\n') {
+    while ((c = fgetc(file)) != EOF && c != '\n');
+    printf("# Note: input line longer than %d characters, cut: %.20s...\n", BUF_LENGTH - 1, buf);
+  }
+
+  return 1;
+}
+
+/* Writes n bytes to file descriptor fd (write may take less at a
+   time, or be interrupted by a signal).
+   Returns 0, or -1 on an error (errno tells which).
+ */
+int writeAll(int fd, const void *data, size_t n)
+{
+  const char *p = (const char *)data;
+  ssize_t done;
+
+  while (n > 0) {
+    done = write(fd, p, n);
+    if (done < 0 && errno == EINTR) continue;
+    if (done < 0) return -1;
+    if (done == 0) {
+      errno = EIO;
+      return -1;
+    }
+    p += done; n -= done;
+  }
+
+  return 0;
+}
+
+/* Gets parameters from file input */
 struct parameters getParametersFromFile(char * filename) {
 
   struct parameters p;
@@ -35,23 +296,11 @@ struct parameters getParametersFromFile(char * filename) {
   FILE * inputFile;
   inputFile = fopen(filename, "r");
 
-  while( fgets(buf, BUF_LENGTH, inputFile) != NULL ) {
-    /* If scanning Time Parameters */
-    if (buf[0] == 'T'){
-      sscanf(buf, "%c %lf %lf %d", &buf[0], &p.time, &p.dt, &p.interval);
-    }
-    /* If scanning Particle Parameters */
-    else if (buf[0] == 'P'){
-      sscanf(buf, "%c %d %d", &buf[0], &p.nIons, &p.nElectrons);
-    }
-    /* If scanning Space Parameters */
-    else if (buf[0] == 'S'){
-      sscanf(buf, "%c %d %lf %lf", &buf[0], &p.nGridPoints, &p.gridStart, &p.gridEnd);
-    }
-    /* If scanning Other Parameters */
-    else if (buf[0] == 'O'){
-      sscanf(buf, "%c %lf %lf %lf", &buf[0], &p.T_i, &p.T_e, &p.k);
-    }
+  /* Optional parameters (default values) */
+  p = defaultParameters();
+
+  while( readLine(inputFile, buf) ) {
+    p = parseParameterLine(p, buf);
   }
   
   fclose(inputFile);
@@ -59,6 +308,47 @@ struct parameters getParametersFromFile(char * filename) {
   return p;
 }
 
+/* Gets the parameter sets of an ensemble from file input.
+   Every line starting with 'E' begins a new member, which starts
+   as a copy of "base"; the following lines (same format as the 
+   input file) override its values.
+   Returns array of parameters, and number of members in nMembers.
+ */
+struct parameters * getEnsembleFromFile(char * filename, struct parameters base, int *nMembers)
+{
+  struct parameters *members;
+  int capacity;
+
+  char buf[BUF_LENGTH];
+
+  FILE * ensembleFile;
+  ensembleFile = fopen(filename, "r");
+
+  capacity = 16;
+  members = (struct parameters *)malloc(capacity * sizeof(struct parameters));
+  *nMembers = 0;
+
+  while( readLine(ensembleFile, buf) ) {
+    /* Start new member */
+    if (buf[0] == 'E') {
+      if (*nMembers == capacity) {
+        capacity *= 2;
+        members = (struct parameters *)realloc(members, capacity * sizeof(struct parameters));
+      }
+      members[*nMembers] = base;
+      *nMembers += 1;
+    }
+    /* Override values of current member */
+    else if (*nMembers > 0) {
+      members[*nMembers - 1] = parseParameterLine(members[*nMembers - 1], buf);
+    }
+  }
+
+  fclose(ensembleFile);
+
+  return members;
+}
+
 /* 
     Writes scalar quantity for grid points (1D grid)
 */
@@ -110,17 +400,71 @@ void writeVector(struct vector2D *a, double t, int nGridPoints, char * filename)
   fclose(outputFile);
 }
 
-/* Field output function: prints arrays related to the field (E, B) */
-void writeFieldOutput(struct field *f, int nGridPoints, double t) {
-  writeScalar(f->Bz, t, nGridPoints, "output/Bz1D.txt");
-  writeVector(f->E, t, nGridPoints, "output/E1D.txt");
+/* Energy output: one line per output (time, kinetic energies, field energy, total) */
+void writeEnergyOutput(struct energy e, double t, double time, char *prefix)
+{
+  char filename[PATH_LENGTH];
+  FILE *outputFile;
+
+  snprintf(filename, PATH_LENGTH, "%senergy.txt", prefix);
+
+  /* Open Output File */
+  if (t == 0) {
+    outputFile = fopen(filename, "w");
+    fprintf(outputFile, "# time\t\tions\t\telectrons\tfield\t\ttotal\n");
+  }
+  else outputFile = fopen(filename, "a");
+
+  /* Write Output */
+  fprintf(outputFile, "%f\t%.10e\t%.10e\t%.10e\t%.10e\n", 
+          time, e.ions, e.electrons, e.field, e.ions + e.electrons + e.others + e.field);
+
+  /* Close Output File */
+  fclose(outputFile);
+}
+
+/* Times output: one line per output (output number, step, time),
+   so that outputs at any cadence can be put on the time axis */
+void writeTimesOutput(int output, int step, double time, char *prefix)
+{
+  char filename[PATH_LENGTH];
+  FILE *outputFile;
+
+  snprintf(filename, PATH_LENGTH, "%stimes.txt", prefix);
+
+  if (output == 0) {
+    outputFile = fopen(filename, "w");
+    fprintf(outputFile, "# output\tstep\ttime\n");
+  }
+  else outputFile = fopen(filename, "a");
+
+  fprintf(outputFile, "%d\t%d\t%.10e\n", output, step, time);
+
+  fclose(outputFile);
+}
+
+/* Field output function: prints arrays related to the field (E, B) 
+   Files are named <prefix><name>, e.g. output/E1D.txt
+*/
+void writeFieldOutput(struct field *f, int nGridPoints, double t, char *prefix) {
+  char filename[PATH_LENGTH];
+
+  snprintf(filename, PATH_LENGTH, "%sBz1D.txt", prefix);
+  writeScalar(f->Bz, t, nGridPoints, filename);
+  snprintf(filename, PATH_LENGTH, "%sE1D.txt", prefix);
+  writeVector(f->E, t, nGridPoints, filename);
 }
 
 /* Grid output wrapper function: prints arrays related to the grid (rho, u etc) */
-void writeGridOutput(struct grid *g, int nGridPoints, double t) {
-  writeScalar(g->rho, t, nGridPoints, "output/rho1D.txt");
-  writeScalar(g->u, t, nGridPoints, "output/potential1D.txt");
-  writeVector(g->J, t, nGridPoints, "output/J1D.txt");
+void writeGridOutput(struct grid *g, int nGridPoints, double t, char *prefix) {
+  char filename[PATH_LENGTH];
+
+  snprintf(filename, PATH_LENGTH, "%srho1D.txt", prefix);
+  writeScalar(g->rho, t, nGridPoints, filename);
+  snprintf(filename, PATH_LENGTH, "%spotential1D.txt", prefix);
+  writeScalar(g->u, t, nGridPoints, filename);
+  snprintf(filename, PATH_LENGTH, "%sJ1D.txt", prefix);
+  writeVector(g->J, t, nGridPoints, filename);
 }
 
 
@@ -1,26 +1,233 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "../headers/structs.h"
+#include "../headers/memory.h"
+
+/* Allocation policy of particle and grid arrays (see setMemoryPolicy) */
+static int memoryPolicy = MEMORY_DEFAULT;
+
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+/* Every array starts with a header recording how it was allocated,
+   so that it can be freed (or grown) the right way.
+   The header takes a whole cache line, to keep the array aligned.
+ */
+#define ARRAY_HEADER 64
+#define ARRAY_MALLOC 0
+#define ARRAY_ALIGNED 1
+#define ARRAY_HUGETLB 2
+
+struct arrayHeader {
+  size_t size;
+  int kind;
+};
+
+/* Sets the allocation policy of particle and grid arrays:
+   MEMORY_DEFAULT:     plain malloc (pages placed by the setup code)
+   MEMORY_FIRST_TOUCH: every array is first written in parallel, with
+                       the static schedule of the particle loops, so 
+                       that (on NUMA machines) its pages are placed on 
+                       the node of the thread that uses them
+   MEMORY_HUGE_PAGES:  as above, and arrays of at least one huge page
+                       are aligned and use transparent huge pages
+   MEMORY_EXPLICIT_HUGE_PAGES: as above, but with explicit huge pages
+                       (hugetlbfs, see /proc/sys/vm/nr_hugepages), 
+                       falling back to transparent ones
+ */
+void setMemoryPolicy(int policy) {
+  memoryPolicy = policy;
+}
+
+int getMemoryPolicy() {
+  return memoryPolicy;
+}
+
+/* Size of an explicit huge page mapping holding size bytes */
+static size_t hugeMappingSize(size_t size) {
+  return (size + ARRAY_HEADER + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+}
+
+/* Array Allocator (following the memory policy).
+   Arrays must be freed by deAllocateArray.
+ */
+void *allocateArray(size_t size) {
+  static int noted = 0;
+  struct arrayHeader *h = NULL;
+  int kind = ARRAY_MALLOC;
+  void *m;
+
+  if (memoryPolicy >= MEMORY_EXPLICIT_HUGE_PAGES && size + ARRAY_HEADER >= HUGE_PAGE_SIZE) {
+    m = mmap(NULL, hugeMappingSize(size), PROT_READ | PROT_WRITE, 
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (m != MAP_FAILED) {
+      h = (struct arrayHeader *)m;
+      kind = ARRAY_HUGETLB;
+    }
+    else if (!noted) {
+      printf("# Note: no explicit huge pages available, using transparent huge pages.\n");
+      noted = 1;
+    }
+  }
+  if (h == NULL && memoryPolicy >= MEMORY_HUGE_PAGES && size + ARRAY_HEADER >= HUGE_PAGE_SIZE) {
+    if (posix_memalign(&m, HUGE_PAGE_SIZE, size + ARRAY_HEADER) == 0) {
+#ifdef MADV_HUGEPAGE
+      madvise(m, size + ARRAY_HEADER, MADV_HUGEPAGE);
+#endif
+      h = (struct arrayHeader *)m;
+      kind = ARRAY_ALIGNED;
+    }
+  }
+  if (h == NULL) {
+    h = (struct arrayHeader *)malloc(size + ARRAY_HEADER);
+  }
+
+  h->size = size;
+  h->kind = kind;
+
+  return (char *)h + ARRAY_HEADER;
+}
+
+/* Array De-Allocator */
+void deAllocateArray(void *p) {
+  struct arrayHeader *h;
+
+  if (p == NULL) return;
+  h = (struct arrayHeader *)((char *)p - ARRAY_HEADER);
+
+  if (h->kind == ARRAY_HUGETLB) munmap(h, hugeMappingSize(h->size));
+  else free(h);
+}
+
+/* Array Re-Allocator (as realloc) */
+void *reallocateArray(void *p, size_t size) {
+  struct arrayHeader *h;
+  void *q;
+
+  if (p == NULL) return allocateArray(size);
+  h = (struct arrayHeader *)((char *)p - ARRAY_HEADER);
+
+  if (h->kind == ARRAY_MALLOC && memoryPolicy < MEMORY_HUGE_PAGES) {
+    h = (struct arrayHeader *)realloc(h, size + ARRAY_HEADER);
+    h->size = size;
+    return (char *)h + ARRAY_HEADER;
+  }
+
+  q = allocateArray(size);
+  memcpy(q, p, (h->size < size) ? h->size : size);
+  deAllocateArray(p);
+
+  return q;
+}
 
 /* Particle Allocator */
-struct particle *allocateParticles(int number) {
-  struct particle *p = (struct particle *)malloc(number * sizeof(struct particle) );
+struct particle *allocateParticles(long number) {
+  long i;
+  struct particle *p = (struct particle *)allocateArray((size_t)number * sizeof(struct particle) );
+
+  /* First touch with the schedule of the particle loops */
+  #pragma omp parallel for schedule(static) if (memoryPolicy >= MEMORY_FIRST_TOUCH)
+  for (i=0; i<number; i++) {
+    memset(&p[i], 0, sizeof(struct particle));
+  }
+
   return p;
 }
 
+/* Particle De-Allocator */
+void deAllocateParticles(struct particle *p) {
+  deAllocateArray(p);
+}
+
+/* Out-of-core Particle Allocator: the array is backed by a file
+   (memory mapped), so it may be larger than the available memory.
+   The file is removed at once (its space is freed when the mapping 
+   goes away), so nothing is left behind after a crash.
+   Returns NULL if the file cannot be created or mapped.
+ */
+struct particle *mapParticles(long number, char *filename) {
+  int fd;
+  size_t size = (size_t)number * sizeof(struct particle);
+  void *p;
+
+  if (size == 0) size = sizeof(struct particle);
+
+  fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return NULL;
+  if (ftruncate(fd, size) != 0) {
+    close(fd); unlink(filename);
+    return NULL;
+  }
+
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  unlink(filename);
+  if (p == MAP_FAILED) return NULL;
+
+  /* Particles are always visited in order: aggressive readahead */
+  madvise(p, size, MADV_SEQUENTIAL);
+
+  return (struct particle *)p;
+}
+
+/* Out-of-core Particle De-Allocator */
+void unmapParticles(struct particle *p, long number) {
+  size_t size = (size_t)number * sizeof(struct particle);
+
+  if (size == 0) size = sizeof(struct particle);
+  munmap(p, size);
+}
+
+/* Particle Buffer Allocator (empty buffer of given capacity) */
+struct particleBuffer allocateParticleBuffer(long capacity) {
+  struct particleBuffer b;
+
+  if (capacity < 1) capacity = 1;
+  b.p = allocateParticles(capacity);
+  b.n = 0;
+  b.capacity = capacity;
+
+  return b;
+}
+
+/* Appends particle to buffer. Capacity is doubled when full, 
+   so that the buffer is reallocated only rarely. 
+ */
+struct particleBuffer appendParticle(struct particleBuffer b, struct particle p) {
+  if (b.n == b.capacity) {
+    b.capacity *= 2;
+    b.p = (struct particle *)reallocateArray(b.p, (size_t)b.capacity * sizeof(struct particle) );
+  }
+  b.p[b.n] = p;
+  b.n += 1;
+
+  return b;
+}
+
+/* Particle Buffer De-Allocator */
+void deAllocateParticleBuffer(struct particleBuffer b) {
+  deAllocateParticles(b.p);
+}
+
 /* Grid Allocator */
 struct grid *allocateGrid(int numberGridPoints) {
   int i;
   struct grid *g = (struct grid *)malloc( sizeof(struct grid) );
 
-  g->u = (double *)malloc(numberGridPoints * sizeof(double) );
-  g->n_i = (double *)malloc(numberGridPoints * sizeof(double) );
-  g->n_e = (double *)malloc(numberGridPoints * sizeof(double) );
-  g->rho = (double *)malloc(numberGridPoints * sizeof(double) );
-  g->J_i = (struct vector2D *)malloc(numberGridPoints * sizeof(struct vector2D) );
-  g->J_e = (struct vector2D *)malloc(numberGridPoints * sizeof(struct vector2D) );
-  g->J = (struct vector2D *)malloc(numberGridPoints * sizeof(struct vector2D) );
+  g->u = (double *)allocateArray(numberGridPoints * sizeof(double) );
+  g->n_i = (double *)allocateArray(numberGridPoints * sizeof(double) );
+  g->n_e = (double *)allocateArray(numberGridPoints * sizeof(double) );
+  g->rho = (double *)allocateArray(numberGridPoints * sizeof(double) );
+  g->J_i = (struct vector2D *)allocateArray(numberGridPoints * sizeof(struct vector2D) );
+  g->J_e = (struct vector2D *)allocateArray(numberGridPoints * sizeof(struct vector2D) );
+  g->J = (struct vector2D *)allocateArray(numberGridPoints * sizeof(struct vector2D) );
+  g->phase = NULL;
 
-  /* Initialize values */
+  /* Initialize values (first touch, see setMemoryPolicy) */
+  #pragma omp parallel for schedule(static) if (memoryPolicy >= MEMORY_FIRST_TOUCH)
   for (i=0;i<numberGridPoints;i++) {
     g->u[i] = 0.0;
     g->n_i[i] = 0.0;
@@ -39,8 +246,8 @@ struct grid *allocateGrid(int numberGridPoints) {
 
 /* Grid De-Allocator */
 void deAllocateGrid(struct grid *g) {
-  free(g->u); free(g->n_i); free(g->n_e); free(g->rho);
-  free(g->J_i); free(g->J_e); free(g->J);
+  deAllocateArray(g->u); deAllocateArray(g->n_i); deAllocateArray(g->n_e); deAllocateArray(g->rho);
+  deAllocateArray(g->J_i); deAllocateArray(g->J_e); deAllocateArray(g->J);
 }
 
 /* Field Allocator */
@@ -48,10 +255,15 @@ struct field *allocateField(int numberGridPoints) {
   int i; 
   struct field *f = (struct field *)malloc( sizeof(struct field) );
 
-  f->E = (struct vector2D *)malloc(numberGridPoints * sizeof(struct vector2D));
-  f->Bz = (double *)malloc(numberGridPoints * sizeof(double));
+  f->E = (struct vector2D *)allocateArray(numberGridPoints * sizeof(struct vector2D));
+  f->Bz = (double *)allocateArray(numberGridPoints * sizeof(double));
+  f->nGridPoints = numberGridPoints;
+  f->open = 0;
+  f->slice = 0;
+  f->firstPoint = 0;
 
-  /* Initialize values */
+  /* Initialize values (first touch, see setMemoryPolicy) */
+  #pragma omp parallel for schedule(static) if (memoryPolicy >= MEMORY_FIRST_TOUCH)
   for (i=0;i<numberGridPoints;i++) {
     f->E[i].x = 0.0;
     f->E[i].y = 0.0;
@@ -63,5 +275,5 @@ struct field *allocateField(int numberGridPoints) {
 
 /* Field De-Allocator */
 void deAllocateField(struct field *f) {
-  free(f->E); free(f->Bz);
+  deAllocateArray(f->E); deAllocateArray(f->Bz);
 }
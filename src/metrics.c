@@ -0,0 +1,276 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Live Metrics
+ ***
+ *** Publishes the progress of a run on a local (Unix domain)
+ *** socket: every client that connects gets one line of JSON with
+ *** the current metrics, and the connection is closed
+ *** (e.g. "socat - UNIX-CONNECT:<path>", or python/metrics.py):
+ ***   step, time, steps per second (recent) and particles per second,
+ ***   wall time per step of each phase (recent, see profile.c), Poisson
+ ***   sweeps and residual of the last solve, energies of the last
+ ***   output, snapshots waiting to be written and frames streamed.
+ ***
+ *** The simulation publishes after every step, a few plain stores
+ *** into a block of atomic values guarded by a sequence counter
+ *** (odd while an update is in progress). A thread of its own
+ *** serves the clients: it copies the block and retries if the
+ *** counter changed meanwhile, so the time step never takes a lock
+ *** and never waits for a client.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/profile.h"
+#include "../headers/poisson.h"
+#include "../headers/compress.h"
+
+/* Longest wait (ms) of the server for a client, before it checks for the end */
+#define ACCEPT_TIMEOUT 200
+#define LINE_LENGTH 2048
+
+/* Published values */
+enum {
+  M_STEP, M_TOTAL_STEPS, M_TIME, M_WALL_TIME, M_STEPS_PER_SECOND, M_PARTICLES,
+  M_POISSON_SWEEPS, M_POISSON_RESIDUAL,
+  M_ENERGY_STEP, M_ENERGY_IONS, M_ENERGY_ELECTRONS, M_ENERGY_OTHERS, M_ENERGY_FIELD,
+  M_SNAPSHOTS_WAITING, M_FRAMES_SENT, M_FRAMES_DROPPED,
+  M_PHASES,
+  N_METRICS = M_PHASES + N_PROFILE_PHASES
+};
+
+/* metricsServer structure: socket, server thread and published values */
+struct metricsServer {
+  char path[PATH_LENGTH];
+  int fd;
+  pthread_t thread;
+  atomic_int done;
+
+  atomic_uint sequence;
+  _Atomic double values[N_METRICS];
+
+  /* Simulation side: start and last update (wall time), smoothed
+     time per step (all and per phase), phase times so far (of the
+     run's profile), Poisson sweeps so far */
+  double start, last, stepTime;
+  double phaseStep[N_PROFILE_PHASES], phaseTotal[N_PROFILE_PHASES];
+  struct profile *profile;
+  long sweeps;
+  long nClients;
+};
+
+/* Copies the published values (consistent: taken between updates) */
+static void readMetrics(struct metricsServer *m, double *v)
+{
+  unsigned int before, after;
+  int k;
+
+  do {
+    before = atomic_load_explicit(&m->sequence, memory_order_acquire);
+    for (k=0; k<N_METRICS; k++) v[k] = atomic_load_explicit(&m->values[k], memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&m->sequence, memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
+
+/* One line of JSON of values v */
+static int formatMetrics(double *v, char *line)
+{
+  int n, p;
+
+  n = snprintf(line, LINE_LENGTH,
+               "{\"step\": %.0f, \"total_steps\": %.0f, \"time\": %.6g, \"wall_time\": %.3f, "
+               "\"steps_per_second\": %.4g, \"particles\": %.0f, \"particles_per_second\": %.4g, "
+               "\"phase_seconds_per_step\": {",
+               v[M_STEP], v[M_TOTAL_STEPS], v[M_TIME], v[M_WALL_TIME], v[M_STEPS_PER_SECOND],
+               v[M_PARTICLES], v[M_STEPS_PER_SECOND]*v[M_PARTICLES]);
+  for (p=0; p<N_PROFILE_PHASES; p++) {
+    n += snprintf(line + n, LINE_LENGTH - n, "%s\"%s\": %.6g", p > 0 ? ", " : "",
+                  profilePhaseName(p), v[M_PHASES + p]);
+  }
+  n += snprintf(line + n, LINE_LENGTH - n,
+                "}, \"poisson\": {\"sweeps\": %.0f, \"residual\": %.6g}, "
+                "\"energy\": {\"step\": %.0f, \"ions\": %.10e, \"electrons\": %.10e, "
+                "\"others\": %.10e, \"field\": %.10e, \"total\": %.10e}, "
+                "\"output\": {\"snapshots_waiting\": %.0f, \"frames_sent\": %.0f, "
+                "\"frames_dropped\": %.0f}}\n",
+                v[M_POISSON_SWEEPS], v[M_POISSON_RESIDUAL], v[M_ENERGY_STEP],
+                v[M_ENERGY_IONS], v[M_ENERGY_ELECTRONS], v[M_ENERGY_OTHERS], v[M_ENERGY_FIELD],
+                v[M_ENERGY_IONS] + v[M_ENERGY_ELECTRONS] + v[M_ENERGY_OTHERS] + v[M_ENERGY_FIELD],
+                v[M_SNAPSHOTS_WAITING], v[M_FRAMES_SENT], v[M_FRAMES_DROPPED]);
+
+  return n < LINE_LENGTH ? n : LINE_LENGTH - 1;
+}
+
+/* Server thread: answers every client with the current metrics */
+static void * metricsThread(void *arg)
+{
+  struct metricsServer *m = (struct metricsServer *)arg;
+  struct pollfd p;
+  double v[N_METRICS];
+  char line[LINE_LENGTH];
+  int client, n;
+
+  p.fd = m->fd;
+  p.events = POLLIN;
+  while (!atomic_load(&m->done)) {
+    if (poll(&p, 1, ACCEPT_TIMEOUT) <= 0) continue;
+    client = accept(m->fd, NULL, NULL);
+    if (client < 0) continue;
+
+    readMetrics(m, v);
+    n = formatMetrics(v, line);
+    /* A client that does not read gets nothing (never blocks) */
+    if (send(client, line, n, MSG_NOSIGNAL | MSG_DONTWAIT) == n) m->nClients++;
+    close(client);
+  }
+
+  return NULL;
+}
+
+/* Stores value k (between beginUpdate and endUpdate) */
+static void setMetric(struct metricsServer *m, int k, double value)
+{
+  atomic_store_explicit(&m->values[k], value, memory_order_relaxed);
+}
+
+static void beginUpdate(struct metricsServer *m)
+{
+  atomic_store_explicit(&m->sequence, atomic_load_explicit(&m->sequence, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void endUpdate(struct metricsServer *m)
+{
+  atomic_store_explicit(&m->sequence, atomic_load_explicit(&m->sequence, memory_order_relaxed) + 1,
+                        memory_order_release);
+}
+
+/* Opens the metrics socket at "path" and starts the server thread.
+   Returns NULL if the socket cannot be bound (ensemble members
+   get a path each, see runEnsemble).
+ */
+struct metricsServer * openMetrics(char *path, struct simulation *s)
+{
+  struct metricsServer *m;
+  struct sockaddr_un address;
+  struct stat st;
+  int k;
+
+  m = (struct metricsServer *)malloc(sizeof(struct metricsServer));
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  strncpy(m->path, address.sun_path, PATH_LENGTH - 1);
+  m->path[PATH_LENGTH - 1] = '\0';
+
+  /* A socket left by an earlier run is replaced, anything else at
+     the path is left alone (bind then fails) */
+  if (lstat(m->path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(m->path);
+  m->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m->fd < 0 || bind(m->fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(m->fd, 8) != 0) {
+    printf("# Note: cannot open the metrics socket %s (live metrics off).\n", path);
+    if (m->fd >= 0) close(m->fd);
+    free(m);
+    return NULL;
+  }
+
+  atomic_init(&m->done, 0);
+  atomic_init(&m->sequence, 0);
+  for (k=0; k<N_METRICS; k++) atomic_init(&m->values[k], 0.0);
+  setMetric(m, M_TOTAL_STEPS, s->totalTimeSteps);
+  m->start = m->last = omp_get_wtime();
+  m->stepTime = 0;
+  for (k=0; k<N_PROFILE_PHASES; k++) {
+    m->phaseStep[k] = 0;
+    m->phaseTotal[k] = profilePhaseTime(s->profile, k);
+  }
+  m->sweeps = s->poisson.iterations;
+  m->profile = s->profile;
+  m->nClients = 0;
+
+  /* Phase wall times, also when not profiling */
+  startPhaseTiming(s->profile);
+
+  if (pthread_create(&m->thread, NULL, metricsThread, m) != 0) {
+    printf("# Note: cannot start the metrics thread (live metrics off).\n");
+    close(m->fd); unlink(m->path);
+    free(m);
+    return NULL;
+  }
+
+  return m;
+}
+
+/* Publishes the state after a time step */
+void updateMetrics(struct metricsServer *m, struct simulation *s)
+{
+  double now = omp_get_wtime(), particles = s->param.nIons + s->param.nElectrons, total;
+  long sweeps = s->poisson.iterations;
+  int k;
+
+  for (k=0; k<s->param.nSpecies; k++) particles += s->param.species[k].number;
+
+  /* Recent step rate, and time of each phase per step (profile.c
+     has them since the start): smoothed over ~10 steps */
+  for (k=0; k<N_PROFILE_PHASES; k++) {
+    total = profilePhaseTime(s->profile, k);
+    m->phaseStep[k] = (m->stepTime > 0) ? 0.9*m->phaseStep[k] + 0.1*(total - m->phaseTotal[k]) :
+                      total - m->phaseTotal[k];
+    m->phaseTotal[k] = total;
+  }
+  m->stepTime = (m->stepTime > 0) ? 0.9*m->stepTime + 0.1*(now - m->last) : now - m->last;
+  m->last = now;
+
+  beginUpdate(m);
+  setMetric(m, M_STEP, s->step);
+  setMetric(m, M_TIME, s->step*s->param.dt);
+  setMetric(m, M_WALL_TIME, now - m->start);
+  setMetric(m, M_STEPS_PER_SECOND, m->stepTime > 0 ? 1.0/m->stepTime : 0);
+  setMetric(m, M_PARTICLES, particles);
+  setMetric(m, M_POISSON_SWEEPS, sweeps - m->sweeps);
+  setMetric(m, M_POISSON_RESIDUAL, s->poisson.residual);
+  for (k=0; k<N_PROFILE_PHASES; k++) setMetric(m, M_PHASES + k, m->phaseStep[k]);
+  if (s->snapshots != NULL) setMetric(m, M_SNAPSHOTS_WAITING, snapshotsWaiting(s->snapshots));
+  if (s->stream != NULL) {
+    setMetric(m, M_FRAMES_SENT, s->stream->nFrames);
+    setMetric(m, M_FRAMES_DROPPED, s->stream->nDropped);
+  }
+  endUpdate(m);
+
+  m->sweeps = sweeps;
+}
+
+/* Publishes the energies of an output */
+void updateEnergyMetrics(struct metricsServer *m, struct energy e, int step)
+{
+  beginUpdate(m);
+  setMetric(m, M_ENERGY_STEP, step);
+  setMetric(m, M_ENERGY_IONS, e.ions);
+  setMetric(m, M_ENERGY_ELECTRONS, e.electrons);
+  setMetric(m, M_ENERGY_OTHERS, e.others);
+  setMetric(m, M_ENERGY_FIELD, e.field);
+  endUpdate(m);
+}
+
+/* Stops the server thread and removes the socket */
+void closeMetrics(struct metricsServer *m)
+{
+  atomic_store(&m->done, 1);
+  pthread_join(m->thread, NULL);
+  close(m->fd);
+  unlink(m->path);
+  stopPhaseTiming(m->profile);
+  printf("# Live metrics: %ld clients served\n", m->nClients);
+}
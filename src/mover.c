@@ -2,20 +2,23 @@
  *** PIC 1d2v electromagnetic: Particle Mover (Runge Kutta 4)
  *******************************************************************/
 
+#include <math.h>
+
 #include "../headers/structs.h"
-#include "../headers/interpolate.h"
+#include "../headers/shape.h"
+#include "../headers/setup.h"
+#include "../headers/definitions.h"
 
 /* Returns the right-hand side of the particle equation of motion:
    rhs -> (Force vector)/mass.
  */
-struct vector2D particleRHS(double x, double v_x, double v_y, 
+static inline struct vector2D particleRHS(double x, double v_x, double v_y, 
 			    double particleCharge, double particleMass,
-			    struct vector2D *E, double *Bz,
-			    double dx)
+			    struct field *f, double dx)
 {
   struct vector2D F, rhs;
 
-  F = particleF(x, v_x, v_y, particleCharge, E, Bz, dx);
+  F = particleF(x, v_x, v_y, particleCharge, f, dx);
 
   rhs.x = F.x/particleMass;
   rhs.y = F.y/particleMass;
@@ -28,60 +31,158 @@ struct vector2D particleRHS(double x, double v_x, double v_y,
    Returns new particle from old 
    (position and velocity in vector2D form).
    Specifically made for PIC 1d2v model ( F = F(x, v_x, v_y, E, B) ).
+   Static inline, so that it is specialised for the constant charge 
+   and mass of each species in moveIon and moveElectron.
+
+   delta-f mode (vth2 > 0): the weight is advanced along the orbit too,
+   dw/dt = -(1 - w) (F/m) d(ln f_0)/dv = (1 - w) (F_x/m) v_x/vth^2
+   for a Maxwellian f_0(v_x) with vth^2 = kT/m (Birdsall-Langdon ch.16-4 
+   style weighting). vth2 = 0: weight is constant (full-f).
 */
-struct particle moveParticle(struct particle p, double charge, double mass, 
-			     struct field *f, 
+static inline struct particle rk4Particle(struct particle p, double charge, double mass, 
+			     double vth2, struct field *f, 
 			     double dx, double h)
 {
   struct vector2D k[4], l[4], rhs;
+  double m[4] = {0};
+  double x = PARTICLE_X(p, dx);
   
   // Stage 1
-  rhs = particleRHS(p.r.x, p.v.x, p.v.y, charge, mass, f->E, f->Bz, dx);
+  rhs = particleRHS(x, p.v.x, p.v.y, charge, mass, f, dx);
   k[0].x = h*rhs.x; //velocity
   k[0].y = h*rhs.y; //velocity
   l[0].x = h*p.v.x; //position
   l[0].y = h*p.v.y; //position
+  if (vth2 > 0) m[0] = h*(1 - p.w)*rhs.x*p.v.x/vth2; //weight
 
   // Stage 2
-  rhs = particleRHS(p.r.x + 0.5*l[0].x, p.v.x + 0.5*k[0].x, p.v.y + 0.5*k[0].y, 
-		    charge, mass, f->E, f->Bz, dx);
+  rhs = particleRHS(x + 0.5*l[0].x, p.v.x + 0.5*k[0].x, p.v.y + 0.5*k[0].y, 
+		    charge, mass, f, dx);
   k[1].x = h*rhs.x; 
   k[1].y = h*rhs.y;
   l[1].x = h*(p.v.x + 0.5*k[0].x); 
   l[1].y = h*(p.v.y + 0.5*k[0].y);
+  if (vth2 > 0) m[1] = h*(1 - p.w - 0.5*m[0])*rhs.x*(p.v.x + 0.5*k[0].x)/vth2;
 
   // Stage 3
-  rhs = particleRHS(p.r.x + 0.5*l[1].x, p.v.x + 0.5*k[1].x, p.v.y + 0.5*k[1].y, 
-		    charge, mass, f->E, f->Bz, dx);
+  rhs = particleRHS(x + 0.5*l[1].x, p.v.x + 0.5*k[1].x, p.v.y + 0.5*k[1].y, 
+		    charge, mass, f, dx);
   k[2].x = h*rhs.x; 
   k[2].y = h*rhs.y;
   l[2].x = h*(p.v.x + 0.5*k[1].x); 
   l[2].y = h*(p.v.y + 0.5*k[1].y);
+  if (vth2 > 0) m[2] = h*(1 - p.w - 0.5*m[1])*rhs.x*(p.v.x + 0.5*k[1].x)/vth2;
 
   // Stage 4
-  rhs = particleRHS(p.r.x + l[2].x, p.v.x + k[2].x, p.v.y + k[2].y, 
-		    charge, mass, f->E, f->Bz, dx);
+  rhs = particleRHS(x + l[2].x, p.v.x + k[2].x, p.v.y + k[2].y, 
+		    charge, mass, f, dx);
   k[3].x = h*rhs.x; 
   k[3].y = h*rhs.y;
   l[3].x = h*(p.v.x + k[2].x); 
   l[3].y = h*(p.v.y + k[2].y);
+  if (vth2 > 0) m[3] = h*(1 - p.w - m[2])*rhs.x*(p.v.x + k[2].x)/vth2;
 
   // Calculate new r, v:
   p.v.x += (1.0/6.0)*( k[0].x + 2*(k[1].x + k[2].x) + k[3].x );
-  p.r.x += (1.0/6.0)*( l[0].x + 2*(l[1].x + l[2].x) + l[3].x );
+  x += (1.0/6.0)*( l[0].x + 2*(l[1].x + l[2].x) + l[3].x );
+  p = setParticleX(p, x, dx);
 
   p.v.y += (1.0/6.0)*( k[0].y + 2*(k[1].y + k[2].y) + k[3].y );
+#ifndef MIXED_PRECISION
   p.r.y += (1.0/6.0)*( l[0].y + 2*(l[1].y + l[2].y) + l[3].y );
+#endif
+
+  if (vth2 > 0) p.w += (1.0/6.0)*( m[0] + 2*(m[1] + m[2]) + m[3] );
 
   return p;
 }
 
+/* Moves particle of any charge and mass */
+struct particle moveParticle(struct particle p, double charge, double mass, 
+			     struct field *f, 
+			     double dx, double h)
+{
+  return rk4Particle(p, charge, mass, 0.0, f, dx, h);
+}
 
+/* Moves particle of any charge and mass, and advances its delta-f weight
+   (vth2: squared thermal speed of f_0, see deltaF_vth2) */
+struct particle moveParticleDeltaF(struct particle p, double charge, double mass, double vth2,
+			     struct field *f, 
+			     double dx, double h)
+{
+  return rk4Particle(p, charge, mass, vth2, f, dx, h);
+}
 
+/* Moves an ion (charge and mass from definitions.h) */
+struct particle moveIon(struct particle p, struct field *f, double dx, double h)
+{
+  return rk4Particle(p, ION_CHARGE, ION_MASS, 0.0, f, dx, h);
+}
 
+/* Moves an electron (charge and mass from definitions.h) */
+struct particle moveElectron(struct particle p, struct field *f, double dx, double h)
+{
+  return rk4Particle(p, ELECTRON_CHARGE, ELECTRON_MASS, 0.0, f, dx, h);
+}
 
+/* Boris velocity update of particle p by a step h in the field at its
+   position: half an electric kick, rotation about Bz, half an
+   electric kick (h < 0 goes back in time) */
+static inline struct particle borisVelocity(struct particle p, double charge, double mass,
+                                            struct field *f, double dx, double h)
+{
+  double x = PARTICLE_X(p, dx);
+  double qh = 0.5*h*charge/mass;
+  struct vector2D pE = particleE(x, f, dx);
+  double t = qh*particleBz(x, f, dx);
+  double s = 2*t/(1 + t*t);
+  double vx, vy;
+
+  /* Half kick */
+  p.v.x += qh*pE.x;
+  p.v.y += qh*pE.y;
+
+  /* Rotation (v x B, B along z: (v_y B, -v_x B)) */
+  vx = p.v.x + p.v.y*t;
+  vy = p.v.y - p.v.x*t;
+  p.v.x += vy*s;
+  p.v.y -= vx*s;
+
+  /* Half kick */
+  p.v.x += qh*pE.x;
+  p.v.y += qh*pE.y;
 
+  return p;
+}
 
+/* Moves particle of any charge and mass with the Boris pusher
+   (Birdsall-Langdon ch.4-3): Boris velocity update, then the drift
+   with the new velocity. One field evaluation per step instead of
+   four (RK4); velocities are those of the leapfrog scheme, half a
+   step behind the positions (see startBoris).
+ */
+struct particle moveParticleBoris(struct particle p, double charge, double mass,
+			     struct field *f, double dx, double h)
+{
+  double x = PARTICLE_X(p, dx);
 
+  p = borisVelocity(p, charge, mass, f, dx, h);
+  p = setParticleX(p, x + h*p.v.x, dx);
+#ifndef MIXED_PRECISION
+  p.r.y += h*p.v.y;
+#endif
 
+  return p;
+}
 
+/* Takes the velocity of particle p (at the time of the positions, as
+   loaded) half a step of h back, where the leapfrog scheme of
+   moveParticleBoris has it. Before the first push, with the field of
+   the initial positions.
+ */
+struct particle startBoris(struct particle p, double charge, double mass,
+                           struct field *f, double dx, double h)
+{
+  return borisVelocity(p, charge, mass, f, dx, -0.5*h);
+}
@@ -0,0 +1,224 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Out-of-core Time Step
+ ***
+ *** For runs with more particles than memory: particle arrays are
+ *** memory mapped files (see mapParticles), and every time step
+ *** reads and writes each particle exactly once, in large sequential
+ *** chunks:
+ ***   - the push and the deposition are fused (each chunk is pushed
+ ***     and then deposited right away, for the next step), and
+ ***   - while a chunk is processed, the next one is read ahead
+ ***     (madvise) and the previous one is marked as done.
+ *** So the order inside a step is push -> deposit -> field solve
+ *** (instead of deposit -> field solve -> push). Particle orbits are
+ *** the same as in the explicit (in memory) mode; grid output is
+ *** that of the particles at output time.
+ *** Threads work on the same chunk, depositing to private arrays
+ *** (those of the deposition of all species, allocated once).
+ *******************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/mover.h"
+#include "../headers/setup.h"
+#include "../headers/shape.h"
+#include "../headers/poisson.h"
+#include "../headers/fields.h"
+#include "../headers/interpolate.h"
+#include "../headers/temperature.h"
+#include "../headers/definitions.h"
+#include "../headers/phasespace.h"
+
+/* Gives advice (madvise) on particles first...first+count-1 of array p
+   (total particles), widened to whole pages.
+ */
+void adviseParticles(struct particle *p, long first, long count, long total, int advice)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  char *start, *end;
+
+  if (first >= total || count <= 0) return;
+  if (first + count > total) count = total - first;
+
+  start = (char *)(p + first);
+  end = (char *)(p + first + count);
+  start = (char *)((size_t)start & ~(size_t)(page - 1));
+
+  madvise(start, end - start, advice);
+}
+
+/* Moves (if push != 0) and deposits particles of one species,
+   chunk by chunk. Deposition goes to n and j as raw sums
+   (see finishDensities), which must be zero on entry.
+   b: private arrays of every thread (see allocateDeposit), of which
+   those of species "species" (0: ions, 1: electrons) are used.
+   Particles are also added to the phase space histograms, if armed.
+ */
+void streamSpecies(struct particle *p, long number, double charge, double mass, double vth2,
+                   double *n, struct vector2D *j, struct field *f, struct depositBuffers *b,
+                   struct parameters param, double dx, int push,
+                   struct phaseSpace *ph, int species)
+{
+  int t, point, nThreads, nGrid = param.nGridPoints;
+  long c, nChunks, chunk = param.chunkSize;
+  size_t size = (size_t)(param.nSpecies + 2)*nGrid, offset = (size_t)species*nGrid;
+
+  nChunks = (number + chunk - 1)/chunk;
+
+  /* Never more threads than arrays */
+  nThreads = omp_get_max_threads();
+  if (nThreads > b->threads) nThreads = b->threads;
+
+  #pragma omp parallel private(c) num_threads(nThreads)
+  {
+    int k, first, cell, point;
+    long i;
+    double x, w[SHAPE_POINTS];
+    double *nt = b->density + omp_get_thread_num()*size + offset;
+    struct vector2D *jt = b->current + omp_get_thread_num()*size + offset;
+    double *h = phaseSpaceBins(ph, omp_get_thread_num(), species);
+
+    #pragma omp single
+    b->used = omp_get_num_threads();
+
+    memset(nt, 0, nGrid*sizeof(double));
+    memset(jt, 0, nGrid*sizeof(struct vector2D));
+
+    for (c=0; c<nChunks; c++) {
+      long last = ((c+1)*chunk < number) ? (c+1)*chunk : number;
+
+      /* Read the next chunk ahead, let the previous one go */
+      #pragma omp single nowait
+      {
+        adviseParticles(p, (c+1)*chunk, chunk, number, MADV_WILLNEED);
+#ifdef MADV_COLD
+        if (c > 0) adviseParticles(p, (c-1)*chunk, chunk, number, MADV_COLD);
+#endif
+      }
+
+      #pragma omp for schedule(static)
+      for (i=c*chunk; i<last; i++) {
+        if (push) {
+          if (vth2 > 0) p[i] = moveParticleDeltaF(p[i], charge, mass, vth2, f, dx, param.dt);
+          else p[i] = moveParticle(p[i], charge, mass, f, dx, param.dt);
+          p[i] = checkPeriodic(p[i], param.gridStart, param.gridEnd, dx);
+        }
+
+        /* Deposit (as nShape, jShape) */
+        cell = PARTICLE_CELL(p[i], dx);
+        x = PARTICLE_X(p[i], dx);
+        first = shapeWeights(x, cell, dx, w);
+        for (k=0; k<SHAPE_POINTS; k++) {
+          point = wrapPoint(first + k, nGrid);
+          nt[point] += w[k]*p[i].w/dx;
+          jt[point].x += w[k]*p[i].w*p[i].v.x/dx;
+          jt[point].y += w[k]*p[i].w*p[i].v.y/dx;
+        }
+
+        if (h != NULL) addToPhaseSpace(h, ph, species, x, p[i].v.x, p[i].w);
+      }
+    }
+  }
+
+  /* Add up threads in fixed order (same result on every run) */
+  for (t=0; t<b->used; t++) {
+    for (point=0; point<nGrid; point++) {
+      n[point] += b->density[t*size + offset + point];
+      j[point].x += b->current[t*size + offset + point].x;
+      j[point].y += b->current[t*size + offset + point].y;
+    }
+  }
+}
+
+/* Turns raw sums of one species into densities (as nShape, jShape).
+   Periodic grid: the two halves of the seam point are folded together.
+   Open walls (open = 1): the wall points are distinct, and hold half a
+   cell each.
+ */
+void finishDensities(double *n, struct vector2D *j, int nGrid, int open, double dx)
+{
+  int i;
+
+  for (i=0; i<nGrid; i++) {
+    n[i] = n[i]/dx;
+  }
+  if (open) {
+    n[0] *= 2; n[nGrid - 1] *= 2;
+    j[0].x *= 2; j[nGrid - 1].x *= 2;
+    j[0].y *= 2; j[nGrid - 1].y *= 2;
+  }
+  else {
+    n[0] += n[nGrid - 1];
+    n[nGrid - 1] = n[0];
+
+    j[0].x += j[nGrid - 1].x;
+    j[nGrid - 1].x = j[0].x;
+    j[0].y += j[nGrid - 1].y;
+    j[nGrid - 1].y = j[0].y;
+  }
+  for (i=0; i<nGrid; i++) {
+    j[i].x = j[i].x/dx;
+    j[i].y = j[i].y/dx;
+  }
+}
+
+/* One pass over all particles (pushing them if push != 0), 
+   followed by the field solve for the new particles
+   (its sweeps counted in stats).
+ */
+void streamParticles(struct particle *ions, struct particle *electrons, struct grid *g, struct field *f,
+                     struct depositBuffers *b, struct poissonStats *stats, struct parameters param,
+                     double dx, int push)
+{
+  int i, nGrid = param.nGridPoints;
+  double vth2_i = deltaF_vth2(param, param.T_i, ION_MASS);
+  double vth2_e = deltaF_vth2(param, param.T_e, ELECTRON_MASS);
+
+  for (i=0; i<nGrid; i++) {
+    g->n_i[i] = 0; g->n_e[i] = 0;
+    g->J_i[i].x = 0; g->J_i[i].y = 0;
+    g->J_e[i].x = 0; g->J_e[i].y = 0;
+  }
+
+  streamSpecies(ions, param.nIons, ION_CHARGE, ION_MASS, vth2_i, g->n_i, g->J_i, f, b, param, dx, push,
+                g->phase, 0);
+  streamSpecies(electrons, param.nElectrons, ELECTRON_CHARGE, ELECTRON_MASS, vth2_e, 
+                g->n_e, g->J_e, f, b, param, dx, push, g->phase, 1);
+
+  finishDensities(g->n_i, g->J_i, nGrid, 0, dx);
+  finishDensities(g->n_e, g->J_e, nGrid, 0, dx);
+
+  /* delta-f mode: particles carry only the perturbation */
+  if (vth2_i > 0) g->n_i = addBackgroundDensity(g->n_i, param.nIons, nGrid, param.gridEnd - param.gridStart);
+  if (vth2_e > 0) g->n_e = addBackgroundDensity(g->n_e, param.nElectrons, nGrid, param.gridEnd - param.gridStart);
+
+  for (i=0; i<nGrid; i++) {
+    g->rho[i] = g->n_i[i]*ION_CHARGE + g->n_e[i]*ELECTRON_CHARGE;
+    g->J[i].x = g->J_i[i].x*ION_CHARGE + g->J_e[i].x*ELECTRON_CHARGE;
+    g->J[i].y = g->J_i[i].y*ION_CHARGE + g->J_e[i].y*ELECTRON_CHARGE;
+  }
+
+  /* Field of the new particles, for the next push */
+  g->u = poisson1D(g->u, g->rho, nGrid, dx, stats);
+  f->E = findEx_fromPotential(f->E, g->u, nGrid, dx);
+}
+
+/* Starts the out-of-core mode: deposits the initial particles 
+   and finds their field */
+void outOfCoreStart(struct particle *ions, struct particle *electrons, struct grid *g, struct field *f,
+                    struct depositBuffers *b, struct poissonStats *stats, struct parameters param, double dx)
+{
+  streamParticles(ions, electrons, g, f, b, stats, param, dx, 0);
+}
+
+/* One out-of-core time step (push, deposition and field solve) */
+void outOfCoreStep(struct particle *ions, struct particle *electrons, struct grid *g, struct field *f,
+                   struct depositBuffers *b, struct poissonStats *stats, struct parameters param, double dx)
+{
+  streamParticles(ions, electrons, g, f, b, stats, param, dx, 1);
+}
@@ -0,0 +1,299 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Performance Regression Harness
+ ***
+ *** Runs a fixed set of canonical cases for a few time steps each,
+ *** and compares with the baselines in perf/<case>.txt:
+ ***   - performance: median time per step (and per phase, see
+ ***     profile.c) must not exceed the baseline by more than the
+ ***     tolerance,
+ ***   - physics: energy drift over the run must not grow, and the
+ ***     checksum of the final state (rho, E, particles) must match
+ ***     bit for bit, so an optimisation that changes results fails.
+ *** Usage: pic1d2v_perf [-u] [-t tolerance] [case ...]
+ ***   -u: (re)writes the baselines instead of comparing
+ ***       (after a deliberate change; baselines are machine specific)
+ *** A case is compared on as many threads as its baseline was
+ *** recorded on (the deposition sums per thread, so the checksum
+ *** depends on the thread count).
+ *** Exit status 1 if any case fails.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/io.h"
+#include "../headers/simulation.h"
+#include "../headers/energy.h"
+#include "../headers/profile.h"
+
+#define BASELINE_DIR "perf/"
+#define LINE_LENGTH 256
+#define MAX_STEPS 1000
+
+/* Canonical cases: input lines on top of the default parameters */
+struct perfCase {
+  char *name, *lines;
+  int steps;
+};
+
+static struct perfCase cases[] = {
+  /* The stock input.txt */
+  {"stock", "T 4.99 0.0001 10\nP 1000 1000\nS 101 0.0 6.2831853\nO 0.0 0.0 1", 1000},
+  /* Large grid: Poisson solve and grid arrays dominate */
+  {"large-grid", "T 4.99 0.0001 10\nP 50000 50000\nS 100001 0.0 6.2831853\nO 0.0 0.0 1", 20},
+  /* 10^7 particles: push and deposition dominate */
+  {"10M-particles", "T 4.99 0.0001 10\nP 5000000 5000000\nS 101 0.0 6.2831853\nO 0.0 0.0 1", 5},
+};
+#define N_CASES (int)(sizeof(cases)/sizeof(cases[0]))
+
+/* Results of one case (also the contents of a baseline file) */
+struct perfResult {
+  int steps, threads;
+  double stepTime, phaseTime[N_PROFILE_PHASES];
+  double energyDrift;
+  uint64_t checksum;
+};
+
+/* FNV-1a hash of n bytes, continuing from h */
+static uint64_t hashBytes(uint64_t h, const void *data, size_t n)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  size_t i;
+
+  for (i=0; i<n; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+  double d = *(const double *)a - *(const double *)b;
+  return (d > 0) - (d < 0);
+}
+
+/* Total energy of a simulation */
+static double totalEnergy(struct simulation *s)
+{
+  struct energy e = simulationEnergy(s);
+  return e.ions + e.electrons + e.others + e.field;
+}
+
+/* Runs one case: a warm-up step, then c.steps timed steps */
+struct perfResult runCase(struct perfCase c)
+{
+  struct perfResult r;
+  struct parameters param = defaultParameters();
+  struct simulation *s;
+  char buf[LINE_LENGTH], *line, *end;
+  double stepTimes[MAX_STEPS], phaseStart[N_PROFILE_PHASES], t, e0;
+  int i, p;
+
+  for (line = c.lines; *line != '\0'; line = (*end == '\0') ? end : end + 1) {
+    end = strchr(line, '\n');
+    if (end == NULL) end = line + strlen(line);
+    snprintf(buf, sizeof(buf), "%.*s", (int)(end - line), line);
+    param = parseParameterLine(param, buf);
+  }
+  param.profile = 1;
+  if (c.steps > MAX_STEPS) c.steps = MAX_STEPS;
+
+  s = setupSimulation(param, BASELINE_DIR);
+
+  /* Warm-up (first Poisson solve starts from zero) */
+  s = stepSimulation(s);
+  s = collectGrid(s);
+  e0 = totalEnergy(s);
+  for (p=0; p<N_PROFILE_PHASES; p++) phaseStart[p] = profilePhaseTime(s->profile, p);
+
+  for (i=0; i<c.steps; i++) {
+    t = omp_get_wtime();
+    s = stepSimulation(s);
+    stepTimes[i] = omp_get_wtime() - t;
+  }
+
+  r.steps = c.steps;
+  r.threads = omp_get_max_threads();
+  qsort(stepTimes, c.steps, sizeof(double), compareDoubles);
+  r.stepTime = stepTimes[c.steps/2];
+  for (p=0; p<N_PROFILE_PHASES; p++) {
+    r.phaseTime[p] = (profilePhaseTime(s->profile, p) - phaseStart[p])/c.steps;
+  }
+  s = collectGrid(s);
+  r.energyDrift = fabs(totalEnergy(s) - e0)/fabs(e0);
+
+  /* Checksum of the final state */
+  r.checksum = 14695981039346656037ULL;
+  r.checksum = hashBytes(r.checksum, s->g->rho, s->param.nGridPoints*sizeof(double));
+  r.checksum = hashBytes(r.checksum, s->f->E, s->param.nGridPoints*sizeof(struct vector2D));
+  if (s->param.nDomains == 0) {
+    r.checksum = hashBytes(r.checksum, s->ions, (size_t)s->param.nIons*sizeof(struct particle));
+    r.checksum = hashBytes(r.checksum, s->electrons, (size_t)s->param.nElectrons*sizeof(struct particle));
+  }
+
+  deAllocateSimulation(s); free(s);
+
+  return r;
+}
+
+/* Writes / reads a baseline file */
+void writeBaseline(char *filename, char *name, struct perfResult r)
+{
+  FILE *file = fopen(filename, "w");
+  int p;
+
+  if (file == NULL) {
+    printf("*** Cannot write baseline %s\n", filename);
+    return;
+  }
+  fprintf(file, "# pic1d2v performance baseline: %s (%d threads)\n", name, r.threads);
+  fprintf(file, "steps %d\n", r.steps);
+  fprintf(file, "step_time %.6e\n", r.stepTime);
+  for (p=0; p<N_PROFILE_PHASES; p++) {
+    if (r.phaseTime[p] > 0) fprintf(file, "phase %d %.6e\n", p, r.phaseTime[p]);
+  }
+  fprintf(file, "energy_drift %.6e\n", r.energyDrift);
+  fprintf(file, "checksum %016llx\n", (unsigned long long)r.checksum);
+  fclose(file);
+}
+
+int readBaseline(char *filename, struct perfResult *r)
+{
+  FILE *file = fopen(filename, "r");
+  char buf[LINE_LENGTH];
+  unsigned long long checksum;
+  int p;
+  double value;
+
+  if (file == NULL) return 0;
+  memset(r, 0, sizeof(*r));
+  while (fgets(buf, LINE_LENGTH, file) != NULL) {
+    if (sscanf(buf, "# pic1d2v performance baseline: %*s (%d threads)", &r->threads) == 1) continue;
+    if (sscanf(buf, "steps %d", &r->steps) == 1) continue;
+    if (sscanf(buf, "step_time %lf", &r->stepTime) == 1) continue;
+    if (sscanf(buf, "phase %d %lf", &p, &value) == 2 && p >= 0 && p < N_PROFILE_PHASES) {
+      r->phaseTime[p] = value;
+    }
+    if (sscanf(buf, "energy_drift %lf", &r->energyDrift) == 1) continue;
+    if (sscanf(buf, "checksum %llx", &checksum) == 1) r->checksum = checksum;
+  }
+  fclose(file);
+  return 1;
+}
+
+/* Compares a result with its baseline. Returns number of failures. */
+int compareWithBaseline(struct perfResult r, struct perfResult b, double tolerance)
+{
+  int p, failures = 0;
+
+  printf("#   %-20s %12s %12s %8s\n", "", "baseline", "now", "change");
+  printf("#   %-20s %12.4e %12.4e %+7.1f%%", "time per step (s)", b.stepTime, r.stepTime,
+         100*(r.stepTime/b.stepTime - 1));
+  if (r.stepTime > b.stepTime*(1 + tolerance)) {
+    printf("   <-- REGRESSION"); failures++;
+  }
+  printf("\n");
+
+  /* Phases: shown, flagged (the total decides) */
+  for (p=0; p<N_PROFILE_PHASES; p++) {
+    if (b.phaseTime[p] <= 0 && r.phaseTime[p] <= 0) continue;
+    printf("#     %-18s %12.4e %12.4e", profilePhaseName(p), b.phaseTime[p], r.phaseTime[p]);
+    if (b.phaseTime[p] > 0) {
+      printf(" %+7.1f%%", 100*(r.phaseTime[p]/b.phaseTime[p] - 1));
+      if (r.phaseTime[p] > b.phaseTime[p]*(1 + tolerance)) printf("   <-- slower");
+    }
+    printf("\n");
+  }
+
+  printf("#   %-20s %12.4e %12.4e", "energy drift", b.energyDrift, r.energyDrift);
+  if (r.energyDrift > b.energyDrift*(1 + 1e-6) + 1e-15) {
+    printf("   <-- PHYSICS CHANGED"); failures++;
+  }
+  printf("\n");
+
+  printf("#   %-20s %016llx %016llx", "checksum", (unsigned long long)b.checksum,
+         (unsigned long long)r.checksum);
+  if (r.checksum != b.checksum) {
+    printf("   <-- RESULTS CHANGED"); failures++;
+  }
+  printf("\n");
+
+  if (r.steps != b.steps) printf("#   (baseline has %d steps, now %d)\n", b.steps, r.steps);
+
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, k, found, update = 0, failures = 0, failedCases = 0, selected[N_CASES], any = 0, threads;
+  double tolerance = 0.15;
+  char filename[PATH_LENGTH];
+  struct perfResult r, b;
+
+  for (k=0; k<N_CASES; k++) selected[k] = 0;
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-u") == 0) update = 1;
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) tolerance = atof(argv[++i]);
+    else {
+      for (k=0, found=0; k<N_CASES; k++) {
+        if (strcmp(argv[i], cases[k].name) == 0) selected[k] = any = found = 1;
+      }
+      if (!found) {
+        printf("Usage: %s [-u] [-t tolerance] [case ...]\nCases:", argv[0]);
+        for (k=0; k<N_CASES; k++) printf(" %s", cases[k].name);
+        printf("\n");
+        return 2;
+      }
+    }
+  }
+
+  printf("\n################ PIC 1d2v performance harness ################\n");
+  threads = omp_get_max_threads();
+  printf("# %d threads, tolerance %.0f%%\n", threads, 100*tolerance);
+
+  for (k=0; k<N_CASES; k++) {
+    if (any && !selected[k]) continue;
+
+    printf("#\n# Case %s (%d steps)\n", cases[k].name, cases[k].steps);
+    snprintf(filename, PATH_LENGTH, "%s%s.txt", BASELINE_DIR, cases[k].name);
+    found = !update && readBaseline(filename, &b);
+
+    /* Same thread count as the baseline */
+    omp_set_num_threads(threads);
+    if (found && b.threads > 0 && b.threads != threads) {
+      printf("#   (run on %d thread(s), as the baseline)\n", b.threads);
+      omp_set_num_threads(b.threads);
+    }
+    fflush(stdout);
+    r = runCase(cases[k]);
+
+    if (update) {
+      writeBaseline(filename, cases[k].name, r);
+      printf("#   baseline written: %s (%.4e s per step)\n", filename, r.stepTime);
+    }
+    else if (!found) {
+      printf("#   *** no baseline %s (run with -u to create it)\n", filename);
+      failedCases++;
+    }
+    else {
+      i = compareWithBaseline(r, b, tolerance);
+      failures += i;
+      if (i > 0) failedCases++;
+    }
+  }
+
+  printf("#\n");
+  if (failedCases > 0) {
+    printf("# *************************************************************\n");
+    printf("# *** FAILED: %d case(s), %d check(s)\n", failedCases, failures);
+    printf("# *************************************************************\n\n");
+    return 1;
+  }
+  printf("# All cases passed.\n###############################################################\n\n");
+  return 0;
+}
@@ -0,0 +1,124 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Phase Space Histograms
+ ***
+ *** In-situ diagnostic of f(x, v_x) for each species: sums of
+ *** particle weights in nx by nv bins, a fixed size output however
+ *** many particles there are (sent in the streaming output, see
+ *** stream.c).
+ *** The histograms are filled by the particle sweep of the
+ *** deposition (jShape, depositSpecies, streamSpecies) in the last
+ *** step before an output that needs them ("armed"), so they cost no
+ *** extra pass. Every thread (or domain) fills a private copy; the
+ *** copies are added up in fixed order afterwards.
+ *** Where no deposition precedes the output (first output, implicit
+ *** step, library calls), phaseSpaceSweep makes a pass of its own.
+ *******************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/phasespace.h"
+
+/* Allocates the histograms (private copies for every thread or domain) */
+struct phaseSpace * allocatePhaseSpace(struct parameters param)
+{
+  struct phaseSpace *ph = (struct phaseSpace *)malloc(sizeof(struct phaseSpace));
+  size_t size;
+
+  ph->every = param.phaseEvery;
+  ph->nx = param.phaseNx > 0 ? param.phaseNx : 1;
+  ph->nv = param.phaseNv > 0 ? param.phaseNv : 1;
+  ph->xMin = param.gridStart;
+  ph->length = param.gridEnd - param.gridStart;
+  ph->vMax[0] = param.phaseVMax_i > 0 ? param.phaseVMax_i : 1.0;
+  ph->vMax[1] = param.phaseVMax_e > 0 ? param.phaseVMax_e : 1.0;
+  ph->nSlots = omp_get_max_threads();
+  if (param.nDomains > ph->nSlots) ph->nSlots = param.nDomains;
+
+  size = (size_t)ph->nx*ph->nv;
+  ph->bins = (double *)calloc((size_t)ph->nSlots*2*size, sizeof(double));
+  ph->f = (double *)calloc(2*size, sizeof(double));
+  ph->armed = 0;
+  ph->ready = 0;
+  ph->step = -1;
+
+  return ph;
+}
+
+/* Phase space De-Allocator */
+void deAllocatePhaseSpace(struct phaseSpace *ph)
+{
+  free(ph->bins); free(ph->f);
+}
+
+/* Makes the next deposition fill the (cleared) private histograms */
+void armPhaseSpace(struct phaseSpace *ph)
+{
+  memset(ph->bins, 0, (size_t)ph->nSlots*2*ph->nx*ph->nv*sizeof(double));
+  ph->armed = 1;
+}
+
+/* Adds up the private histograms into f (of the particles at "step") */
+void finishPhaseSpace(struct phaseSpace *ph, int step)
+{
+  size_t i, size = (size_t)2*ph->nx*ph->nv;
+  int slot;
+
+  memset(ph->f, 0, size*sizeof(double));
+  for (slot=0; slot<ph->nSlots; slot++) {
+    double *h = ph->bins + slot*size;
+    for (i=0; i<size; i++) ph->f[i] += h[i];
+  }
+
+  ph->armed = 0;
+  ph->ready = 1;
+  ph->step = step;
+}
+
+/* Histograms of n particles of one species, on the threads of the
+   enclosing parallel region (private histogram per thread) */
+static void sweepSpecies(struct phaseSpace *ph, int species, struct particle *p, long n, double dx)
+{
+  long i;
+  double *h = phaseSpaceBins(ph, omp_get_thread_num(), species);
+
+  #pragma omp for schedule(static)
+  for (i=0; i<n; i++) {
+    addToPhaseSpace(h, ph, species, PARTICLE_X(p[i], dx), p[i].v.x, p[i].w);
+  }
+}
+
+/* Histograms of the current particles, in a pass of their own */
+void phaseSpaceSweep(struct simulation *s)
+{
+  struct phaseSpace *ph = s->g->phase;
+  int d;
+
+  armPhaseSpace(ph);
+
+  if (s->param.nDomains > 0) {
+    #pragma omp parallel for schedule(static,1)
+    for (d=0; d<s->param.nDomains; d++) {
+      struct particleBuffer ions = s->dom[d].ions, electrons = s->dom[d].electrons;
+      long i;
+      double *h_i = phaseSpaceBins(ph, d, 0), *h_e = phaseSpaceBins(ph, d, 1);
+
+      for (i=0; i<ions.n; i++) {
+        addToPhaseSpace(h_i, ph, 0, PARTICLE_X(ions.p[i], s->dx), ions.p[i].v.x, ions.p[i].w);
+      }
+      for (i=0; i<electrons.n; i++) {
+        addToPhaseSpace(h_e, ph, 1, PARTICLE_X(electrons.p[i], s->dx), electrons.p[i].v.x, electrons.p[i].w);
+      }
+    }
+  }
+  else {
+    #pragma omp parallel
+    {
+      sweepSpecies(ph, 0, s->ions, s->param.nIons, s->dx);
+      sweepSpecies(ph, 1, s->electrons, s->param.nElectrons, s->dx);
+    }
+  }
+
+  finishPhaseSpace(ph, s->step);
+}
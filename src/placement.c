@@ -0,0 +1,136 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Page Placement Report
+ ***
+ *** Shows where the pages of the large arrays live: the NUMA node
+ *** of (a sample of) their pages, found with the move_pages system
+ *** call (which only queries when no target nodes are given), and
+ *** how much of them is backed by huge pages (/proc/self/smaps).
+ *** Used to check the memory policy (see setMemoryPolicy).
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "../headers/structs.h"
+
+#define MAX_NODES 64
+#define MAX_SAMPLES 4096
+
+/* Counts pages of [p, p + size) per NUMA node (sampling at most
+   MAX_SAMPLES pages). count[MAX_NODES] gets pages not yet touched.
+   Returns number of pages sampled, or 0 if move_pages is unavailable.
+ */
+int pagesPerNode(void *p, size_t size, int *count)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  size_t i, nPages, step;
+  int k, n, *status;
+  void **pages;
+
+  for (k=0; k<=MAX_NODES; k++) count[k] = 0;
+
+  nPages = (size + page - 1)/page;
+  if (nPages == 0) return 0;
+  step = (nPages + MAX_SAMPLES - 1)/MAX_SAMPLES;
+  n = (int)((nPages + step - 1)/step);
+
+  pages = (void **)malloc(n * sizeof(void *));
+  status = (int *)malloc(n * sizeof(int));
+  for (k=0, i=0; k<n; k++, i+=step) {
+    pages[k] = (void *)(((size_t)p & ~(size_t)(page - 1)) + i*page);
+  }
+
+#ifdef SYS_move_pages
+  if (syscall(SYS_move_pages, 0, (unsigned long)n, pages, NULL, status, 0) != 0) n = 0;
+#else
+  n = 0;
+#endif
+
+  for (k=0; k<n; k++) {
+    if (status[k] >= 0 && status[k] < MAX_NODES) count[status[k]]++;
+    else count[MAX_NODES]++;
+  }
+
+  free(pages); free(status);
+
+  return n;
+}
+
+/* Returns the kB of huge pages backing [p, p + size) (from /proc/self/smaps:
+   transparent huge pages, or the whole mappings with a huge kernel page size) */
+long hugePagesKB(void *p, size_t size)
+{
+  char line[256];
+  unsigned long start, end, value;
+  size_t from = (size_t)p, to = (size_t)p + size;
+  int inside = 0;
+  long kB = 0, mappingKB = 0;
+  FILE *smaps = fopen("/proc/self/smaps", "r");
+
+  if (smaps == NULL) return -1;
+
+  while (fgets(line, sizeof(line), smaps) != NULL) {
+    /* Start of a mapping: "start-end perms ..." */
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+      inside = (start < to && end > from);
+      mappingKB = (end - start)/1024;
+    }
+    else if (inside && sscanf(line, "AnonHugePages: %lu kB", &value) == 1) {
+      kB += value;
+    }
+    else if (inside && sscanf(line, "KernelPageSize: %lu kB", &value) == 1 && value >= 2048) {
+      kB += mappingKB;
+    }
+  }
+
+  fclose(smaps);
+
+  return kB;
+}
+
+/* Prints page placement of one array */
+void reportPlacement(char *name, void *p, size_t size)
+{
+  int k, n, count[MAX_NODES + 1];
+  long kB;
+
+  n = pagesPerNode(p, size, count);
+  kB = hugePagesKB(p, size);
+
+  printf("# %-16s %10.1f MB, huge pages in mapping: ", name, size/1048576.0);
+  if (kB < 0) printf("unknown");
+  else printf("%.1f MB", kB/1024.0);
+
+  printf(", nodes:");
+  if (n == 0) printf(" unknown");
+  for (k=0; k<MAX_NODES; k++) {
+    if (count[k] > 0) printf(" %d: %.0f%%", k, 100.0*count[k]/n);
+  }
+  if (count[MAX_NODES] > 0) printf(" (not mapped: %.0f%%)", 100.0*count[MAX_NODES]/n);
+  printf("\n");
+}
+
+/* Prints page placement of the large arrays of a simulation */
+void reportSimulationPlacement(struct simulation *s)
+{
+  int d;
+  char name[32];
+
+  printf("#\n# Page placement (memory policy %d):\n", s->param.memoryPolicy);
+
+  if (s->param.nDomains > 0) {
+    for (d=0; d<s->param.nDomains; d++) {
+      snprintf(name, sizeof(name), "ions (domain %d)", d);
+      reportPlacement(name, s->dom[d].ions.p, s->dom[d].ions.capacity*sizeof(struct particle));
+      snprintf(name, sizeof(name), "electrons (d. %d)", d);
+      reportPlacement(name, s->dom[d].electrons.p, s->dom[d].electrons.capacity*sizeof(struct particle));
+    }
+  }
+  else {
+    reportPlacement("ions", s->ions, (size_t)s->param.nIons*sizeof(struct particle));
+    reportPlacement("electrons", s->electrons, (size_t)s->param.nElectrons*sizeof(struct particle));
+  }
+  reportPlacement("rho", s->g->rho, s->param.nGridPoints*sizeof(double));
+  reportPlacement("E", s->f->E, s->param.nGridPoints*sizeof(struct vector2D));
+}
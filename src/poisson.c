@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "../headers/structs.h"
+
 /* A Single 1D Jacobi Iteration - Periodic Boundaries! 
    Solves (d^2/dx^2)u = - rho 
 */
@@ -70,8 +72,9 @@ double residual (double *u, double *rho, double h, int size)
 /* Jacobi Wrapper Function. Normalizes vaccuum permittivity (ε_0) to 1 
    Warning: Assumes boundary conditions have been set!
             This function DOES NOT operate on boundaries!
+   Sweeps and residual are added to the run's stats (if not NULL).
 */
-double * poisson1D (double *u, double *rho, int size, double h)
+double * poisson1D (double *u, double *rho, int size, double h, struct poissonStats *stats)
 {
   int i, j, t, maxIterations, nIterations, iterationsPerCheck;
   double res, tolerance;
@@ -110,6 +113,11 @@ double * poisson1D (double *u, double *rho, int size, double h)
 
     } while (res > tolerance && nIterations <= maxIterations);
 
+  if (stats != NULL) {
+    stats->iterations += nIterations;
+    stats->residual = res;
+  }
+
 
   /* If max iterations are reached, give warning */
   if (nIterations>maxIterations) {
@@ -0,0 +1,118 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Probes
+ ***
+ *** Time series of E_x, rho and u at a few grid points, sampled at
+ *** every time step (instead of every output), for dispersion
+ *** analysis at full time resolution (see analysis/fourier_probes.py).
+ *** Samples are kept in memory and written in large binary blocks.
+ ***
+ *** File <prefix>probes.bin (native byte order):
+ ***   header:  char magic[4] = "PICP", int32 number of probes,
+ ***            int32 values per probe (3), int32 (unused), double dt,
+ ***            int32 grid point of every probe
+ ***   records: double time, then E_x, rho, u of every probe
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../headers/structs.h"
+#include "../headers/poisson.h"
+#include "../headers/io.h"
+
+#define PROBE_VALUES 3
+
+/* Writes n bytes to the probe file. The first error is reported,
+   and nothing is written after it. */
+static void writeProbes(struct probeBuffer *pb, const void *data, size_t n)
+{
+  if (pb->failed) return;
+  if (writeAll(pb->fd, data, n) != 0) {
+    printf("# Note: cannot write the probes (%s), probes.bin is incomplete.\n", strerror(errno));
+    pb->failed = 1;
+  }
+}
+
+/* Opens <prefix>probes.bin and the sample buffer.
+   Returns NULL if the file cannot be created.
+ */
+struct probeBuffer * openProbes(struct parameters param, double dt, char *prefix)
+{
+  char filename[PATH_LENGTH];
+  struct probeBuffer *pb;
+  int32_t header[4];
+
+  snprintf(filename, PATH_LENGTH, "%sprobes.bin", prefix);
+  pb = (struct probeBuffer *)malloc(sizeof(struct probeBuffer));
+  pb->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (pb->fd < 0) {
+    free(pb);
+    return NULL;
+  }
+
+  pb->blockSize = param.probeBlock > 0 ? param.probeBlock : 4096;
+  pb->recordSize = 1 + PROBE_VALUES*param.nProbes;
+  pb->samples = (double *)malloc((size_t)pb->blockSize*pb->recordSize*sizeof(double));
+  pb->nSamples = 0;
+  pb->nWritten = 0;
+  pb->failed = 0;
+
+  memcpy(&header[0], "PICP", 4);
+  header[1] = param.nProbes;
+  header[2] = PROBE_VALUES;
+  header[3] = 0;
+  writeProbes(pb, header, sizeof(header));
+  writeProbes(pb, &dt, sizeof(double));
+  writeProbes(pb, param.probePoints, param.nProbes*sizeof(int32_t));
+
+  return pb;
+}
+
+/* Writes the samples in the buffer as one block */
+void flushProbes(struct probeBuffer *pb)
+{
+  writeProbes(pb, pb->samples, (size_t)pb->nSamples*pb->recordSize*sizeof(double));
+  pb->nWritten += pb->nSamples;
+  pb->nSamples = 0;
+}
+
+/* Samples the probes after a time step. The grid holds the particles
+   deposited at the start of the step (at the end in the out-of-core
+   and implicit modes), which sets the time of the sample.
+ */
+void sampleProbes(struct simulation *s)
+{
+  struct probeBuffer *pb = s->probes;
+  double *record = pb->samples + (size_t)pb->nSamples*pb->recordSize;
+  int k, point;
+
+  /* The implicit step does not need the potential: find it for the probes */
+  if (s->param.implicit) {
+    s->g->u = poisson1D(s->g->u, s->g->rho, s->param.nGridPoints, s->dx, &s->poisson);
+  }
+
+  if (s->param.outOfCore || s->param.implicit) record[0] = s->step*s->param.dt;
+  else record[0] = (s->step - 1)*s->param.dt;
+
+  for (k=0; k<s->param.nProbes; k++) {
+    point = s->param.probePoints[k];
+    record[1 + PROBE_VALUES*k] = s->f->E[point].x;
+    record[2 + PROBE_VALUES*k] = s->g->rho[point];
+    record[3 + PROBE_VALUES*k] = s->g->u[point];
+  }
+
+  pb->nSamples++;
+  if (pb->nSamples == pb->blockSize) flushProbes(pb);
+}
+
+/* Writes the remaining samples and closes the file */
+void closeProbes(struct probeBuffer *pb)
+{
+  flushProbes(pb);
+  close(pb->fd);
+  free(pb->samples);
+}
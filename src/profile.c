@@ -0,0 +1,406 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Phase Profiling
+ ***
+ *** Wall time and hardware counters (Linux perf_event: cycles,
+ *** instructions, L1 data cache misses, last level cache misses,
+ *** branch misses) of every phase of the explicit step (rho and J
+ *** deposition, Poisson solve, E field, push), counted per thread.
+ *** The report puts them on a roofline: a flop and byte count per
+ *** particle (or grid point) of every kernel gives its arithmetic
+ *** intensity, and the attainable performance min(peak, intensity
+ *** * bandwidth) tells whether it is compute or bandwidth bound;
+ *** a kernel far below both roofs is latency bound.
+ *** The roofs are given in input.txt, or measured by two short
+ *** loops (triad and independent multiply-adds) at report time.
+ ***
+ *** Counters are often unavailable (containers, virtual machines,
+ *** perf_event_paranoid): the report then shows time and the model
+ *** numbers only. Every run has a profile of its own; ensemble
+ *** members share the threads, so theirs is wall time only.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/shape.h"
+#include "../headers/profile.h"
+
+#define MAX_THREADS 256
+#define N_EVENTS 5
+#define CACHE_EVENT(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* Counted events */
+static const char *eventNames[N_EVENTS] =
+  {"cycles", "instructions", "L1D misses", "LLC misses", "branch misses"};
+static const int eventTypes[N_EVENTS] =
+  {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+static const unsigned long long eventConfigs[N_EVENTS] =
+  {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D),
+   CACHE_EVENT(PERF_COUNT_HW_CACHE_LL), PERF_COUNT_HW_BRANCH_MISSES};
+
+/* Phases: name, and whether all threads work in it (else thread 0 only) */
+static const char *phaseNames[N_PROFILE_PHASES] =
+  {"rho, J deposit", "Poisson", "J deposit", "E field", "push", "step (other modes)"};
+static const int phaseParallel[N_PROFILE_PHASES] = {1, 0, 0, 0, 1, 1};
+
+/* Counter reading: value, time enabled, time running (multiplexing) */
+struct counterReading {
+  unsigned long long value, enabled, running;
+};
+
+/* Profile of one run: counters of its threads and, per phase, totals
+   and counter readings at the start of the phase.
+   timing: wall time of the phases only (no counters, no report),
+   see startPhaseTiming */
+struct profile {
+  int profiling, timing;
+  int nThreads, nEvents;
+  int fds[MAX_THREADS][N_EVENTS];
+  int eventOpen[N_EVENTS];
+  int openError;
+  double workingSet;
+  struct {
+    long calls;
+    double time, start, items;
+    double counts[MAX_THREADS][N_EVENTS];
+    struct counterReading first[MAX_THREADS][N_EVENTS];
+  } phases[N_PROFILE_PHASES];
+};
+
+static long perfEventOpen(struct perf_event_attr *attr)
+{
+  return syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+/* Opens the counters of the calling thread (slot t) */
+static void openThreadCounters(struct profile *p, int t)
+{
+  struct perf_event_attr attr;
+  int e;
+
+  for (e=0; e<N_EVENTS; e++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = eventTypes[e];
+    attr.config = eventConfigs[e];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    p->fds[t][e] = (int)perfEventOpen(&attr);
+    if (p->fds[t][e] < 0 && t == 0) p->openError = errno;
+  }
+}
+
+static struct counterReading readCounter(int fd)
+{
+  struct counterReading r = {0, 0, 0};
+
+  if (fd >= 0 && read(fd, &r, sizeof(r)) != sizeof(r)) r.value = 0;
+  return r;
+}
+
+/* Profile Allocator (nothing is profiled or timed yet) */
+struct profile * allocateProfile()
+{
+  return (struct profile *)calloc(1, sizeof(struct profile));
+}
+
+/* Starts profiling. Inside a parallel region (ensemble members, which
+   share the threads with other members) the counters would count the
+   other members too: wall time only. */
+void startProfiling(struct profile *p, struct parameters param)
+{
+  int e, t;
+
+  memset(p->phases, 0, sizeof(p->phases));
+  p->workingSet = (double)(param.nIons + param.nElectrons)*sizeof(struct particle) +
+                  14.0*param.nGridPoints*sizeof(double);
+  p->nThreads = omp_in_parallel() ? 1 : omp_get_max_threads();
+  if (p->nThreads > MAX_THREADS) p->nThreads = MAX_THREADS;
+  p->openError = 0;
+
+  if (omp_in_parallel()) {
+    printf("# Note: ensemble members share the hardware counters, profiling wall time only.\n");
+    for (t=0; t<p->nThreads; t++) {
+      for (e=0; e<N_EVENTS; e++) p->fds[t][e] = -1;
+    }
+  }
+  else {
+    #pragma omp parallel num_threads(p->nThreads)
+    openThreadCounters(p, omp_get_thread_num());
+  }
+
+  p->nEvents = 0;
+  for (e=0; e<N_EVENTS; e++) {
+    p->eventOpen[e] = (p->fds[0][e] >= 0);
+    p->nEvents += p->eventOpen[e];
+  }
+  if (p->nEvents < N_EVENTS && !omp_in_parallel()) {
+    printf("# Note: %d of %d hardware counters unavailable (%s)%s.\n", N_EVENTS - p->nEvents, N_EVENTS,
+           strerror(p->openError), p->nEvents == 0 ? ", profiling wall time only" : "");
+  }
+
+  p->profiling = 1;
+}
+
+/* Reads the counters of the calling thread (slot t) into r */
+static void readThreadCounters(struct profile *p, int t, struct counterReading *r)
+{
+  int e;
+
+  for (e=0; e<N_EVENTS; e++) r[e] = readCounter(p->fds[t][e]);
+}
+
+/* Adds the counts since "first" (scaled for multiplexing) to counts */
+static void addThreadCounts(struct profile *p, int t, struct counterReading *first, double *counts)
+{
+  struct counterReading now;
+  double value, enabled, running;
+  int e;
+
+  for (e=0; e<N_EVENTS; e++) {
+    if (p->fds[t][e] < 0) continue;
+    now = readCounter(p->fds[t][e]);
+    value = (double)(now.value - first[e].value);
+    enabled = (double)(now.enabled - first[e].enabled);
+    running = (double)(now.running - first[e].running);
+    counts[e] += (running > 0) ? value*enabled/running : 0;
+  }
+}
+
+/* Start of phase "phase" */
+void profileStart(struct profile *p, int phase)
+{
+  if (!p->profiling && !p->timing) return;
+
+  if (p->nEvents > 0 && phaseParallel[phase]) {
+    #pragma omp parallel num_threads(p->nThreads)
+    readThreadCounters(p, omp_get_thread_num(), p->phases[phase].first[omp_get_thread_num()]);
+  }
+  else if (p->nEvents > 0) {
+    readThreadCounters(p, 0, p->phases[phase].first[0]);
+  }
+  p->phases[phase].start = omp_get_wtime();
+}
+
+/* End of phase "phase", which worked on "items" particles (or grid points) */
+void profileStop(struct profile *p, int phase, double items)
+{
+  if (!p->profiling && !p->timing) return;
+
+  p->phases[phase].time += omp_get_wtime() - p->phases[phase].start;
+  p->phases[phase].items += items;
+  p->phases[phase].calls++;
+
+  if (p->nEvents > 0 && phaseParallel[phase]) {
+    #pragma omp parallel num_threads(p->nThreads)
+    {
+      int t = omp_get_thread_num();
+      addThreadCounts(p, t, p->phases[phase].first[t], p->phases[phase].counts[t]);
+    }
+  }
+  else if (p->nEvents > 0) {
+    addThreadCounts(p, 0, p->phases[phase].first[0], p->phases[phase].counts[0]);
+  }
+}
+
+/* Returns 1 while profiling */
+int profilingOn(struct profile *p)
+{
+  return p->profiling;
+}
+
+/* Name and total time so far of phase "phase" */
+const char * profilePhaseName(int phase)
+{
+  return phaseNames[phase];
+}
+
+double profilePhaseTime(struct profile *p, int phase)
+{
+  return p->phases[phase].time;
+}
+
+/* Model flops and bytes (main memory traffic) per item of every phase:
+   particles are streamed (read, and written by the push), grid arrays
+   stay in cache; Poisson and E field items are grid point updates.
+   Counted from the kernels for SHAPE_POINTS points per particle.
+ */
+static void phaseModel(int phase, double *flops, double *bytes)
+{
+  double P = SHAPE_POINTS;
+
+  switch (phase) {
+  case PROFILE_RHO:     *flops = 2 + 15*P;   *bytes = sizeof(struct particle); break;
+  case PROFILE_POISSON: *flops = 5;          *bytes = 3*sizeof(double); break;
+  case PROFILE_J:       *flops = 2 + 10*P;   *bytes = sizeof(struct particle); break;
+  case PROFILE_FIELD:   *flops = 2;          *bytes = 3*sizeof(double); break;
+  default:              *flops = 111 + 32*P; *bytes = 2*sizeof(struct particle); break;
+  }
+}
+
+/* Measures the roofs: GFLOP/s of independent multiply-adds and
+   GB/s of a triad a = b + s*c over arrays much larger than caches */
+static void measureRoofs(double *peak, double *bandwidth)
+{
+  long i, n = 1L << 22;
+  int r, repeats = 5;
+  double t, *a, *b, *c;
+  double flops = 0, sum = 0;
+
+  a = (double *)malloc(n*sizeof(double));
+  b = (double *)malloc(n*sizeof(double));
+  c = (double *)malloc(n*sizeof(double));
+  #pragma omp parallel for schedule(static)
+  for (i=0; i<n; i++) { a[i] = 0; b[i] = 1; c[i] = 2; }
+
+  t = omp_get_wtime();
+  for (r=0; r<repeats; r++) {
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<n; i++) a[i] = b[i] + 0.5*c[i];
+  }
+  *bandwidth = repeats*3.0*n*sizeof(double)/(omp_get_wtime() - t)/1e9;
+
+  /* 8 independent chains, so that the latency of the operations is hidden */
+  t = omp_get_wtime();
+  #pragma omp parallel reduction(+:flops, sum)
+  {
+    double x[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    long k;
+    int j;
+
+    for (k=0; k<n; k++) {
+      for (j=0; j<8; j++) x[j] = x[j]*0.999999 + 1e-7;
+    }
+    for (j=0; j<8; j++) sum += x[j];
+    flops += 2.0*8*n;
+  }
+  *peak = flops/(omp_get_wtime() - t)/1e9;
+  /* (sum keeps the loop from being optimised away) */
+  if (sum < 0) printf("%f\n", sum);
+
+  free(a); free(b); free(c);
+}
+
+/* Prints the profile of the run (per phase, all threads added up) and
+   the roofline report. peak (GFLOP/s) and bandwidth (GB/s) of the
+   machine: measured if not positive.
+ */
+void printProfileReport(struct profile *prof, double peak, double bandwidth)
+{
+  int p, e, t;
+  double total = 0, flops, bytes, gflops, intensity, measured, attainable, counts[N_EVENTS];
+  char *bound;
+  long cache;
+
+  if (!prof->profiling) return;
+
+  if (peak <= 0 || bandwidth <= 0) {
+    double measuredPeak, measuredBandwidth;
+    measureRoofs(&measuredPeak, &measuredBandwidth);
+    if (peak <= 0) peak = measuredPeak;
+    if (bandwidth <= 0) bandwidth = measuredBandwidth;
+  }
+
+  for (p=0; p<N_PROFILE_PHASES; p++) total += prof->phases[p].time;
+
+  printf("\n##################### Profile (%d threads) #####################\n", prof->nThreads);
+  printf("# Roofs: %.2f GFLOP/s, %.2f GB/s (ridge at %.2f flop/byte)\n",
+         peak, bandwidth, peak/bandwidth);
+  /* The model assumes particles come from memory */
+  cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (cache <= 0) cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (cache > 0 && prof->workingSet < cache) {
+    printf("# Note: working set (%.2f MB) fits in the cache (%.2f MB): model flop/byte\n"
+           "#       is a lower bound, bandwidth bounds are too pessimistic.\n",
+           prof->workingSet/1048576, cache/1048576.0);
+  }
+  printf("#\n");
+  printf("# %-18s %8s %10s %6s", "phase", "calls", "time (s)", "%");
+  for (e=0; e<N_EVENTS; e++) if (prof->eventOpen[e]) printf(" %14s", eventNames[e]);
+  printf("\n");
+
+  for (p=0; p<N_PROFILE_PHASES; p++) {
+    if (prof->phases[p].calls == 0) continue;
+    for (e=0; e<N_EVENTS; e++) {
+      counts[e] = 0;
+      for (t=0; t<prof->nThreads; t++) counts[e] += prof->phases[p].counts[t][e];
+    }
+    printf("# %-18s %8ld %10.4f %6.1f", phaseNames[p], prof->phases[p].calls, prof->phases[p].time,
+           total > 0 ? 100*prof->phases[p].time/total : 0);
+    for (e=0; e<N_EVENTS; e++) if (prof->eventOpen[e]) printf(" %14.4g", counts[e]);
+    printf("\n");
+  }
+
+  printf("#\n# %-18s %9s %9s %9s %6s %8s %9s  %s\n", "phase", "flop/B", "flop/B", "GFLOP/s",
+         "% roof", "IPC", "LLC/k-ins", "bound");
+  printf("# %-18s %9s %9s %9s %6s %8s %9s\n", "", "(model)", "(LLC)", "(model)", "", "", "");
+
+  for (p=0; p<N_PROFILE_PHASES; p++) {
+    if (prof->phases[p].calls == 0 || prof->phases[p].time <= 0) continue;
+    for (e=0; e<N_EVENTS; e++) {
+      counts[e] = 0;
+      for (t=0; t<prof->nThreads; t++) counts[e] += prof->phases[p].counts[t][e];
+    }
+
+    phaseModel(p, &flops, &bytes);
+    intensity = flops/bytes;
+    gflops = flops*prof->phases[p].items/prof->phases[p].time/1e9;
+    /* Measured intensity: memory traffic from last level cache misses (64 byte lines) */
+    measured = (prof->eventOpen[3] && counts[3] > 0) ? flops*prof->phases[p].items/(64*counts[3]) : 0;
+    if (measured > 0) intensity = measured;
+    attainable = (intensity*bandwidth < peak) ? intensity*bandwidth : peak;
+
+    /* Near the roof: bound by it; far below both: latency bound */
+    if (gflops < 0.25*attainable) bound = "latency";
+    else if (intensity*bandwidth < peak) bound = "bandwidth";
+    else bound = "compute";
+
+    printf("# %-18s %9.3f", phaseNames[p], flops/bytes);
+    if (measured > 0) printf(" %9.3f", measured);
+    else printf(" %9s", "n/a");
+    printf(" %9.3f %6.1f", gflops, 100*gflops/attainable);
+    if (prof->eventOpen[0] && prof->eventOpen[1] && counts[0] > 0) printf(" %8.2f", counts[1]/counts[0]);
+    else printf(" %8s", "n/a");
+    if (prof->eventOpen[1] && prof->eventOpen[3] && counts[1] > 0) printf(" %9.3f", 1000*counts[3]/counts[1]);
+    else printf(" %9s", "n/a");
+    printf("  %s\n", bound);
+  }
+  printf("#################################################################\n");
+}
+
+/* Closes the counters */
+void stopProfiling(struct profile *p)
+{
+  int t, e;
+
+  if (!p->profiling) return;
+  for (t=0; t<p->nThreads; t++) {
+    for (e=0; e<N_EVENTS; e++) {
+      if (p->fds[t][e] >= 0) close(p->fds[t][e]);
+    }
+  }
+  p->profiling = 0;
+}
+
+/* Times the phases without profiling them (wall time only, for the
+   live metrics; a no-op while profiling, which times them anyway) */
+void startPhaseTiming(struct profile *p)
+{
+  if (p->profiling || p->timing) return;
+  memset(p->phases, 0, sizeof(p->phases));
+  p->timing = 1;
+}
+
+void stopPhaseTiming(struct profile *p)
+{
+  p->timing = 0;
+}
@@ -0,0 +1,250 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Particle Resampling (merge / split)
+ ***
+ *** Keeps the number of (weighted) particles per cell near a target:
+ ***   - Cells with too many particles: particles are grouped by
+ ***     velocity (sorted by v_x into slices, each slice sorted by v_y
+ ***     into groups), and every group is merged into two particles.
+ ***     The pair keeps the total weight (charge), momentum and kinetic
+ ***     energy of the group: both have half the weight, sit at the
+ ***     group's centre of charge, and have velocities V +- dv, with V
+ ***     the mean velocity and dv along the main axis of the group's
+ ***     velocity spread, |dv|^2 = <|v - V|^2> (see Vranic et al.,
+ ***     Comput. Phys. Commun. 191 (2015) 65).
+ ***   - Cells with too few particles: heavy particles are split in two
+ ***     halves with the same velocity, displaced symmetrically inside
+ ***     the cell. This conserves everything exactly (and for CIC does
+ ***     not even change the deposited charge).
+ *** Full-f particles only (delta-f weights are signed).
+ *******************************************************************/
+#include <stdlib.h>
+#include <math.h>
+
+#include "../headers/structs.h"
+#include "../headers/memory.h"
+#include "../headers/setup.h"
+
+/* A cell is resampled when its count leaves [target/2, 3*target/2] */
+#define MERGE_FACTOR 1.5
+#define SPLIT_FACTOR 0.5
+
+/* Comparison functions for qsort */
+static int compareVx(const void *a, const void *b)
+{
+  double d = ((const struct particle *)a)->v.x - ((const struct particle *)b)->v.x;
+  return (d > 0) - (d < 0);
+}
+
+static int compareVy(const void *a, const void *b)
+{
+  double d = ((const struct particle *)a)->v.y - ((const struct particle *)b)->v.y;
+  return (d > 0) - (d < 0);
+}
+
+/* Merges the group p[0]...p[n-1] into two particles, appended to out */
+struct particleBuffer mergeGroup(struct particleBuffer out, struct particle *p, long n, double dx)
+{
+  long i;
+  double W, X, Y, Vx, Vy, cxx, cyy, cxy, dv, angle;
+  struct particle a, b;
+
+  /* Total weight, centre of charge and mean velocity */
+  W = 0; X = 0; Y = 0; Vx = 0; Vy = 0;
+  for (i=0; i<n; i++) {
+    W += p[i].w;
+    X += p[i].w*PARTICLE_X(p[i], dx);
+#ifndef MIXED_PRECISION
+    Y += p[i].w*p[i].r.y;
+#endif
+    Vx += p[i].w*p[i].v.x;
+    Vy += p[i].w*p[i].v.y;
+  }
+  X /= W; Y /= W; Vx /= W; Vy /= W;
+
+  /* Velocity spread (covariance) of the group */
+  cxx = 0; cyy = 0; cxy = 0;
+  for (i=0; i<n; i++) {
+    cxx += p[i].w*(p[i].v.x - Vx)*(p[i].v.x - Vx);
+    cyy += p[i].w*(p[i].v.y - Vy)*(p[i].v.y - Vy);
+    cxy += p[i].w*(p[i].v.x - Vx)*(p[i].v.y - Vy);
+  }
+  cxx /= W; cyy /= W; cxy /= W;
+
+  /* Two particles at V +- dv, dv along the main axis of the spread */
+  dv = sqrt(cxx + cyy);
+  angle = 0.5*atan2(2*cxy, cxx - cyy);
+
+  a = p[0];
+  a.w = 0.5*W;
+  a = setParticleX(a, X, dx);
+#ifndef MIXED_PRECISION
+  a.r.y = Y;
+#endif
+  b = a;
+
+  a.v.x = Vx + dv*cos(angle);
+  a.v.y = Vy + dv*sin(angle);
+  b.v.x = Vx - dv*cos(angle);
+  b.v.y = Vy - dv*sin(angle);
+
+  out = appendParticle(out, a);
+  out = appendParticle(out, b);
+
+  return out;
+}
+
+/* Merges the n particles of one cell into about "target" particles */
+struct particleBuffer mergeCell(struct particleBuffer out, struct particle *p, long n,
+                                long target, double dx)
+{
+  long nGroups, nSlices, groupsPerSlice, s, g, sliceStart, sliceEnd, start, end;
+
+  /* Every group becomes two particles */
+  nGroups = target/2;
+  if (nGroups < 1) nGroups = 1;
+  nSlices = (long)ceil(sqrt((double)nGroups));
+  groupsPerSlice = (nGroups + nSlices - 1)/nSlices;
+
+  /* Slices in v_x, then groups in v_y inside each slice */
+  qsort(p, n, sizeof(struct particle), compareVx);
+  for (s=0; s<nSlices; s++) {
+    sliceStart = (s*n)/nSlices;
+    sliceEnd = ((s+1)*n)/nSlices;
+    qsort(p + sliceStart, sliceEnd - sliceStart, sizeof(struct particle), compareVy);
+
+    for (g=0; g<groupsPerSlice; g++) {
+      start = sliceStart + (g*(sliceEnd - sliceStart))/groupsPerSlice;
+      end = sliceStart + ((g+1)*(sliceEnd - sliceStart))/groupsPerSlice;
+
+      /* Groups of one or two particles gain nothing from merging */
+      if (end - start > 2) {
+        out = mergeGroup(out, p + start, end - start, dx);
+      }
+      else {
+        for (; start<end; start++) out = appendParticle(out, p[start]);
+      }
+    }
+  }
+
+  return out;
+}
+
+/* Splits the heavy particles of one cell (n particles, cell index "cell"),
+   so that the count gets closer to "target".
+   A particle is heavy when it carries more than twice the weight
+   of a particle of the target count.
+ */
+struct particleBuffer splitCell(struct particleBuffer out, struct particle *p, long n,
+                                long target, int cell, double dx)
+{
+  long i, count;
+  double W, x, shift;
+  struct particle a, b;
+
+  W = 0;
+  for (i=0; i<n; i++) W += p[i].w;
+
+  count = n;
+  for (i=0; i<n; i++) {
+    if (count < target && p[i].w > 2*W/target) {
+      /* Two halves, displaced symmetrically (staying inside the cell) */
+      x = PARTICLE_X(p[i], dx);
+      shift = 0.5*fmin(x - cell*dx, (cell + 1)*dx - x);
+      a = p[i];
+      a.w = 0.5*p[i].w;
+      b = a;
+      a = setParticleX(a, x - shift, dx);
+      b = setParticleX(b, x + shift, dx);
+
+      out = appendParticle(out, a);
+      out = appendParticle(out, b);
+      count++;
+    }
+    else {
+      out = appendParticle(out, p[i]);
+    }
+  }
+
+  return out;
+}
+
+/* Sorts particles p[0]...p[n-1] by cell into sorted[0]...sorted[n-1]
+   (counting sort, stable), so that the deposition and the field
+   interpolation walk through the grid in order.
+ */
+void sortByCell(struct particle *p, struct particle *sorted, long n, int nCells, double dx)
+{
+  long i, *start;
+  int cell;
+
+  start = (long *)calloc(nCells + 1, sizeof(long));
+
+  for (i=0; i<n; i++) {
+    cell = PARTICLE_CELL(p[i], dx);
+    cell = (cell < 0) ? 0 : (cell >= nCells ? nCells - 1 : cell);
+    start[cell + 1]++;
+  }
+  for (cell=0; cell<nCells; cell++) start[cell + 1] += start[cell];
+  for (i=0; i<n; i++) {
+    cell = PARTICLE_CELL(p[i], dx);
+    cell = (cell < 0) ? 0 : (cell >= nCells ? nCells - 1 : cell);
+    sorted[start[cell]++] = p[i];
+  }
+
+  free(start);
+}
+
+/* Resamples one species (particles in buffer b, all inside cells
+   firstCell...lastCell-1: the whole grid, or the cells of a domain),
+   so that every cell holds about "target" particles.
+   Returns the new buffer (the old one is freed).
+ */
+struct particleBuffer resampleSpecies(struct particleBuffer b, long target, int firstCell, int lastCell,
+                                      double dx)
+{
+  long i, *count, *start;
+  int cell, k, nCells = lastCell - firstCell;
+  struct particle *sorted;
+  struct particleBuffer out;
+
+  count = (long *)calloc(nCells + 1, sizeof(long));
+  start = (long *)malloc((nCells + 1) * sizeof(long));
+  sorted = allocateParticles(b.n);
+
+  /* Sort particles by cell (counting sort, k: cell in the range) */
+  for (i=0; i<b.n; i++) {
+    k = PARTICLE_CELL(b.p[i], dx) - firstCell;
+    k = (k < 0) ? 0 : (k >= nCells ? nCells - 1 : k);
+    count[k]++;
+  }
+  start[0] = 0;
+  for (k=0; k<nCells; k++) start[k+1] = start[k] + count[k];
+  for (i=0; i<b.n; i++) {
+    k = PARTICLE_CELL(b.p[i], dx) - firstCell;
+    k = (k < 0) ? 0 : (k >= nCells ? nCells - 1 : k);
+    sorted[start[k]++] = b.p[i];
+  }
+
+  /* Merge, split, or copy every cell */
+  out = allocateParticleBuffer(b.capacity);
+  for (k=0; k<nCells; k++) {
+    struct particle *p = sorted + start[k] - count[k];
+    long n = count[k];
+
+    cell = firstCell + k;
+    if (n > MERGE_FACTOR*target) {
+      out = mergeCell(out, p, n, target, dx);
+    }
+    else if (n > 0 && n < SPLIT_FACTOR*target) {
+      out = splitCell(out, p, n, target, cell, dx);
+    }
+    else {
+      for (i=0; i<n; i++) out = appendParticle(out, p[i]);
+    }
+  }
+
+  free(count); free(start); deAllocateParticles(sorted);
+  deAllocateParticleBuffer(b);
+
+  return out;
+}
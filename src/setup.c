@@ -18,8 +18,8 @@
  *********************************************************************************/
 
 /* Applies initial perturbation to ions */
-struct particle * perturbIons(struct particle *p, int number, double k) {
-  int i;
+struct particle * perturbIons(struct particle *p, long number, double k) {
+  long i;
   double A;
 
   /* Enter Ion Perturbation here */
@@ -31,16 +31,45 @@ struct particle * perturbIons(struct particle *p, int number, double k) {
   return p;
 }
 
-/* Applies initial perturbation to electrons */
-struct particle * perturbElectrons(struct particle *p, int number, double k) {
-  int i;
-  double A;
+/* Applies initial perturbation to electrons.
+   In delta-f mode (vth2 > 0) the velocity perturbation dv goes to the
+   weights instead: f = f_0(v - dv) ~ f_0 (1 + dv*v/vth^2),
+   so w = delta_f/f_0 = dv*v/vth^2.
+ */
+struct particle * perturbElectrons(struct particle *p, long number, double k, double vth2) {
+  long i;
+  double A, dv;
 
   /* Enter Electron Perturbation here */
   A = 0.5;
   for (i=0;i<number;i++) {
-    p[i].v.x += A*sin(k*2.0*M_PI*i/(number-1));
+    dv = A*sin(k*2.0*M_PI*i/(number-1));
+    if (vth2 > 0) p[i].w = dv*p[i].v.x/vth2;
+    else p[i].v.x += dv;
+  }
+
+  return p;
+}
+
+/* Sets particle position to x.
+   In mixed precision mode, x is split into cell index and offset. 
+ */
+struct particle setParticleX (struct particle p, double x, double dx)
+{
+#ifndef MIXED_PRECISION
+  p.r.x = x;
+#else
+  double s = x/dx;
+
+  p.cell = (int)floor(s);
+  p.offset = (float)(s - p.cell);
+
+  /* Offset may round up to 1 in float */
+  if (p.offset >= 1.0f) {
+    p.offset = 0.0f;
+    p.cell += 1;
   }
+#endif
 
   return p;
 }
@@ -51,13 +80,15 @@ struct particle * perturbElectrons(struct particle *p, int number, double k) {
    ATTENTION: ONLY WORKS IF DISPLACEMENT IS NO MORE THAN ONE GRID LENGTH!!!
    This follows Birdsall and Langdon ES1 approach (Birdsall,Langdon, section 3-7)
  */
-struct particle checkPeriodic (struct particle p, double left_bound, double right_bound) 
+struct particle checkPeriodic (struct particle p, double left_bound, double right_bound, double dx) 
 {
-  if (p.r.x > right_bound) {
-      p.r.x = p.r.x - (right_bound - left_bound);
+  double x = PARTICLE_X(p, dx);
+
+  if (x > right_bound) {
+      p = setParticleX(p, x - (right_bound - left_bound), dx);
     }
-    else if (p.r.x < left_bound) {
-      p.r.x = p.r.x + (right_bound - left_bound);
+    else if (x < left_bound) {
+      p = setParticleX(p, x + (right_bound - left_bound), dx);
     }
 
   return p;
@@ -66,30 +97,37 @@ struct particle checkPeriodic (struct particle p, double left_bound, double righ
 /* Initializes and returns electrons */
 struct particle * setupElectrons(struct particle * p, struct parameters param) 
 {
-  int i;
+  long i;
+  double dx = (param.gridEnd - param.gridStart)/(param.nGridPoints - 1);
 
   /* Apply initial position to electrons */
   for(i=0;i<param.nElectrons;i++) {
     // This sets up electrons uniformly (and NOT on grid points!)
-    p[i].r.x = (i+1)*(param.gridEnd - param.gridStart)/(param.nElectrons+1);
+    p[i] = setParticleX(p[i], (i+1)*(param.gridEnd - param.gridStart)/(param.nElectrons+1), dx);
+#ifndef MIXED_PRECISION
     p[i].r.y = 0.0;
+#endif
   }
 
-  /* Apply initial velocity */
+  /* Apply initial velocity (and weight) */
   for(i=0;i<param.nElectrons;i++) {
     p[i].v.x = 0.0;
     p[i].v.y = 0.0;
+    p[i].w = deltaF_vth2(param, param.T_e, ELECTRON_MASS) > 0 ? 0.0 : 1.0;
   }
 
-  /* Apply Temperature */
-  p = Maxwell_Boltzmann(p, param.T_e, param.nElectrons, ELECTRON_MASS);
+  /* Apply Temperature (quiet start: base 2) */
+  if (param.quietStart) {
+    p = quietMaxwell_Boltzmann(p, param.T_e, param.nElectrons, ELECTRON_MASS, 2, param.quietMirror);
+  }
+  else p = Maxwell_Boltzmann(p, param.T_e, param.nElectrons, ELECTRON_MASS);
 
   /* Apply perturbations */
-  p = perturbElectrons(p, param.nElectrons, param.k);
+  p = perturbElectrons(p, param.nElectrons, param.k, deltaF_vth2(param, param.T_e, ELECTRON_MASS));
 
   /* Check Periodic Conditions */
   for (i=0; i<param.nElectrons; i++) {
-    p[i] = checkPeriodic(p[i], param.gridStart, param.gridEnd);
+    p[i] = checkPeriodic(p[i], param.gridStart, param.gridEnd, dx);
   }
 
   return p;
@@ -98,30 +136,37 @@ struct particle * setupElectrons(struct particle * p, struct parameters param)
 /* Initializes and returns ions */
 struct particle * setupIons(struct particle * p, struct parameters param) 
 {
-  int i;
+  long i;
+  double dx = (param.gridEnd - param.gridStart)/(param.nGridPoints - 1);
 
   /* Apply initial position */
   for(i=0;i<param.nIons;i++) {
     // This sets up ions uniformly (and NOT on grid points!)
-    p[i].r.x = (i+1)*(param.gridEnd - param.gridStart)/(param.nIons+1);
+    p[i] = setParticleX(p[i], (i+1)*(param.gridEnd - param.gridStart)/(param.nIons+1), dx);
+#ifndef MIXED_PRECISION
     p[i].r.y = 0.0;
+#endif
   }
 
-  /* Apply initial velocity */
+  /* Apply initial velocity (and weight) */
   for(i=0;i<param.nIons;i++) {
     p[i].v.x = 0.0;
     p[i].v.y = 0.0;
+    p[i].w = deltaF_vth2(param, param.T_i, ION_MASS) > 0 ? 0.0 : 1.0;
   }
 
-  /* Apply Temperature (i.e. thermal velocity)*/
-  p = Maxwell_Boltzmann(p, param.T_i, param.nIons, ION_MASS);
+  /* Apply Temperature (i.e. thermal velocity; quiet start: base 3) */
+  if (param.quietStart) {
+    p = quietMaxwell_Boltzmann(p, param.T_i, param.nIons, ION_MASS, 3, param.quietMirror);
+  }
+  else p = Maxwell_Boltzmann(p, param.T_i, param.nIons, ION_MASS);
 
   /* Apply perturbations */
   p = perturbIons(p, param.nIons, 0.0);
 
   /* Check Periodic Conditions */
   for (i=0; i<param.nIons; i++) {
-    p[i] = checkPeriodic(p[i], param.gridStart, param.gridEnd);
+    p[i] = checkPeriodic(p[i], param.gridStart, param.gridEnd, dx);
   }
 
   return p;
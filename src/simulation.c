@@ -0,0 +1,563 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Simulation
+ *** Setup, time step and main loop of a single run.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/memory.h"
+#include "../headers/io.h"
+#include "../headers/setup.h"
+#include "../headers/wrappers.h"
+#include "../headers/fields.h"
+#include "../headers/mover.h"
+#include "../headers/domain.h"
+#include "../headers/energy.h"
+#include "../headers/temperature.h"
+#include "../headers/implicit.h"
+#include "../headers/poisson.h"
+#include "../headers/resample.h"
+#include "../headers/outofcore.h"
+#include "../headers/placement.h"
+#include "../headers/stream.h"
+#include "../headers/phasespace.h"
+#include "../headers/probes.h"
+#include "../headers/compress.h"
+#include "../headers/boundary.h"
+#include "../headers/species.h"
+#include "../headers/metrics.h"
+#include "../headers/cadence.h"
+#include "../headers/profile.h"
+
+#include "../headers/definitions.h"
+
+/* Allocates and sets up a simulation from given parameters.
+   Output is written as <outputPrefix><name>.
+ */
+struct simulation * setupSimulation(struct parameters param, char *outputPrefix)
+{
+  struct simulation *s = (struct simulation *)malloc( sizeof(struct simulation) );
+
+  /* Calculate secondary parameters */
+  s->totalTimeSteps = (int)(param.time/param.dt);
+  s->nOutput = s->totalTimeSteps/param.interval;
+    if (s->totalTimeSteps%param.interval!=0) s->nOutput +=1;
+  s->dx = (param.gridEnd - param.gridStart)/(param.nGridPoints - 1);
+  /* delta-f mode is not implemented for the decomposed mode */
+  if (param.deltaF && param.nDomains > 0) {
+    printf("# Note: delta-f mode runs without domain decomposition.\n");
+    param.nDomains = 0;
+  }
+  /* The implicit step does not advance delta-f weights, 
+     and is not implemented for the decomposed mode */
+  if (param.implicit && param.deltaF) {
+    printf("# Note: implicit time step is not available in delta-f mode (explicit step used).\n");
+    param.implicit = 0;
+  }
+  if (param.implicit && param.nDomains > 0) {
+    printf("# Note: implicit time step runs without domain decomposition.\n");
+    param.nDomains = 0;
+  }
+  /* Out-of-core mode streams plain particle arrays: other modes that 
+     keep extra copies of the particles (or reallocate them) are off */
+  if (param.outOfCore && (param.nDomains > 0 || param.implicit || param.resampleInterval > 0)) {
+    printf("# Note: out-of-core mode runs without domains, implicit step and resampling.\n");
+    param.nDomains = 0;
+    param.implicit = 0;
+    param.resampleInterval = 0;
+  }
+  /* Open boundaries: plain explicit mode only (particle numbers change) */
+  if (param.openBoundaries && (param.nDomains > 0 || param.implicit || param.outOfCore || param.deltaF)) {
+    printf("# Note: open boundaries run without domains, implicit step, out-of-core and delta-f modes.\n");
+    param.nDomains = 0;
+    param.implicit = 0;
+    param.outOfCore = 0;
+    param.deltaF = 0;
+  }
+  /* Additional species: plain explicit mode, periodic particle boundaries */
+  param = checkSpecies(param);
+  if (param.nSpecies > 0 && param.openBoundaries) {
+    printf("# Note: additional species are not available with open boundaries (dropped).\n");
+    param.nSpecies = 0;
+  }
+  if (param.nSpecies > 0 && (param.nDomains > 0 || param.implicit || param.outOfCore)) {
+    printf("# Note: additional species run without domains, implicit step and out-of-core mode.\n");
+    param.nDomains = 0;
+    param.implicit = 0;
+    param.outOfCore = 0;
+  }
+  if (param.chunkSize < 1) param.chunkSize = 1;
+  /* Domains must be at least two cells wide (guard points of TSC shape) */
+  if (param.nDomains > (param.nGridPoints - 1)/2) param.nDomains = (param.nGridPoints - 1)/2;
+
+  /* Resampling target: given, or the initial number of particles per cell */
+  s->ionsTarget = param.resampleTarget > 0 ? param.resampleTarget : param.nIons/(param.nGridPoints - 1);
+  s->electronsTarget = param.resampleTarget > 0 ? param.resampleTarget : param.nElectrons/(param.nGridPoints - 1);
+  if (s->ionsTarget < 2) s->ionsTarget = 2;
+  if (s->electronsTarget < 2) s->electronsTarget = 2;
+  s->step = 0;
+  s->poisson.iterations = 0;
+  s->poisson.residual = 0;
+  s->profile = allocateProfile();
+
+  s->param = param;
+  strncpy(s->outputPrefix, outputPrefix, PATH_LENGTH - 1);
+  s->outputPrefix[PATH_LENGTH - 1] = '\0';
+
+  /* Threads (given, or chosen by the autotuner, else the OpenMP default)
+     and memory policy are process-wide: ensemble members, set up in
+     parallel, leave them to runEnsemble */
+  if (!omp_in_parallel()) {
+    if (param.nThreads > 0) omp_set_num_threads(param.nThreads);
+    setMemoryPolicy(param.memoryPolicy);
+  }
+
+  /*** Memory Allocation ***********************/
+  if (param.outOfCore) {
+    /* Particle files live next to the output */
+    char filename[PATH_LENGTH];
+    snprintf(filename, PATH_LENGTH, "%sions.particles", s->outputPrefix);
+    s->ions = mapParticles(param.nIons, filename);
+    snprintf(filename, PATH_LENGTH, "%selectrons.particles", s->outputPrefix);
+    s->electrons = mapParticles(param.nElectrons, filename);
+
+    if (s->ions == NULL || s->electrons == NULL) {
+      printf("# Note: cannot map particle files (%s...), particles are kept in memory.\n", s->outputPrefix);
+      if (s->ions != NULL) unmapParticles(s->ions, param.nIons);
+      if (s->electrons != NULL) unmapParticles(s->electrons, param.nElectrons);
+      param.outOfCore = 0;
+      s->param.outOfCore = 0;
+    }
+  }
+  if (!param.outOfCore) {
+    s->ions = allocateParticles(param.nIons);
+    s->electrons = allocateParticles(param.nElectrons); 
+  }
+  s->g = allocateGrid(param.nGridPoints);
+  s->f = allocateField(param.nGridPoints);
+
+  /************* Setup ********************/
+  /* Particles:
+     The random number generator is global, so simultaneous
+     setups (ensemble mode) must take turns. */
+  #pragma omp critical (particleSetup)
+  {
+    s->electrons = setupElectrons(s->electrons, param);
+    s->ions = setupIons(s->ions, param);
+  }
+  s = allocateSpecies(s);
+
+  /* Open particle boundaries (absorbing / injecting walls) */
+  s->open = NULL;
+  if (param.openBoundaries) s->open = allocateOpenBoundary(s);
+  s->f->open = param.openBoundaries;
+
+  /* Apply boundary conditions (potential): */
+  s->g->u = applyBoundaryConditions1D (s->g->u, param.nGridPoints, 0.0, 0.0);
+
+  /* Set initial fields */
+  // Set Steady/uniform Bz
+  s->f->Bz = setBz(s->f->Bz, param.nGridPoints);
+
+  /* Domain decomposition: hand particles over to their domains
+     (which keep the only copy) */
+  s->dom = NULL;
+  if (param.nDomains > 0) {
+    s->dom = allocateDomains(param, s->f->Bz);
+    s->dom = distributeParticles(s->dom, s->ions, s->electrons, param, s->dx);
+    deAllocateParticles(s->ions); deAllocateParticles(s->electrons);
+    s->ions = NULL; s->electrons = NULL;
+  }
+
+  /* Implicit mode: initial E from Poisson's equation (later updated by Ampere's law) */
+  s->im = NULL;
+  if (param.implicit) {
+    s->g = fromParticlesToGrid(s->g, s->ions, s->electrons, param, s->dx, s->profile, &s->poisson);
+    s->f->E = findEx_fromPotential (s->f->E, s->g->u, param.nGridPoints, s->dx);
+    s->im = allocateImplicit(s->ions, s->electrons, param);
+  }
+
+  /* Out-of-core mode: grid quantities and field of the initial particles */
+  if (param.outOfCore) {
+    outOfCoreStart(s->ions, s->electrons, s->g, s->f, &s->deposit, &s->poisson, param, s->dx);
+  }
+
+  /* Streaming output (connects to the viewer when it is there) */
+  s->stream = NULL;
+  if (param.streamTarget[0] != '\0') {
+    s->param = checkStreamVariables(s->param);
+    s->stream = openStream(param.streamTarget);
+  }
+
+  /* Phase space histograms (sent in the streaming output) */
+  if (param.phaseEvery > 0 && s->stream == NULL) {
+    printf("# Note: phase space histograms are sent in the streaming output only (off).\n");
+  }
+  else if (param.phaseEvery > 0) {
+    s->g->phase = allocatePhaseSpace(s->param);
+  }
+
+  /* Probes (grid points outside the grid are dropped) */
+  s->probes = NULL;
+  if (param.nProbes > 0) {
+    int k, n = 0;
+
+    for (k=0; k<param.nProbes; k++) {
+      if (param.probePoints[k] >= 0 && param.probePoints[k] < param.nGridPoints) {
+        s->param.probePoints[n++] = param.probePoints[k];
+      }
+    }
+    s->param.nProbes = n;
+    if (n > 0) s->probes = openProbes(s->param, param.dt, s->outputPrefix);
+  }
+
+  /* Compressed snapshots (written by a thread of their own) */
+  s->snapshots = NULL;
+  if (param.snapshotMode > 0) s->snapshots = openSnapshots(param, s->dx, s->outputPrefix);
+
+  /* Profiling of the phases of the time step (see profile.c) */
+  if (param.profile) startProfiling(s->profile, s->param);
+
+  /* Adaptive output: between minInterval and maxInterval steps
+     (default: ten times the fixed interval) */
+  s->cadence = NULL;
+  if (param.adaptiveOutput) {
+    if (s->param.minInterval < 1) s->param.minInterval = 1;
+    if (s->param.maxInterval <= 0) s->param.maxInterval = 10*param.interval;
+    if (s->param.maxInterval < s->param.minInterval) s->param.maxInterval = s->param.minInterval;
+    s->cadence = allocateCadence(s->param);
+  }
+
+  /* Live metrics (served by a thread of their own) */
+  s->metrics = NULL;
+  if (param.metricsPath[0] != '\0') s->metrics = openMetrics(param.metricsPath, s);
+
+  if (param.memoryReport) reportSimulationPlacement(s);
+
+  return s;
+}
+
+/* Moves the particles of all species (ions and electrons: RK4) with
+   the current field, in one batch (see species.c) */
+struct simulation * pushParticles(struct simulation *s)
+{
+  struct speciesEntry table[MAX_SPECIES + 2];
+  int nSpecies = speciesTable(s, table);
+
+  pushAllSpecies(table, nSpecies, s->f, s->param, s->dx, s->step, s->param.openBoundaries);
+
+  return s;
+}
+
+/* Grid quantities of all species (n -> rho, j -> J, in one batch) 
+   and the potential u */
+struct simulation * depositParticles(struct simulation *s)
+{
+  struct speciesEntry table[MAX_SPECIES + 2];
+  int k, nSpecies = speciesTable(s, table);
+  long nParticles = 0;
+  long iterations = s->poisson.iterations;
+
+  for (k=0; k<nSpecies; k++) nParticles += table[k].n;
+
+  profileStart(s->profile, PROFILE_RHO);
+  depositAllSpecies(table, nSpecies, &s->deposit, s->g, s->param, s->dx);
+  profileStop(s->profile, PROFILE_RHO, nParticles);
+
+  profileStart(s->profile, PROFILE_POISSON);
+  s->g->u = poisson1D(s->g->u, s->g->rho, s->param.nGridPoints, s->dx, &s->poisson);
+  profileStop(s->profile, PROFILE_POISSON, (double)(s->poisson.iterations - iterations)*s->param.nGridPoints);
+
+  return s;
+}
+
+/* Explicit time step (RK4 push with the field of the current particles) */
+struct simulation * explicitStep(struct simulation *s)
+{
+  /* Calculate grid quantities (interpolate n -> rho, j -> J and solve for potential u) */
+  s = depositParticles(s);
+
+  /* Differentiate potential (u) to get the Electric Field E_x ( du/dx = -E(x) )*/
+  profileStart(s->profile, PROFILE_FIELD);
+  s->f->E = findEx_fromPotential (s->f->E, s->g->u, s->param.nGridPoints, s->dx); 
+  if (s->open != NULL) s->f->E = openBoundaryField(s->f->E, s->g->u, s->param.nGridPoints, s->dx);
+  profileStop(s->profile, PROFILE_FIELD, s->param.nGridPoints);
+
+  /* Move ions and electrons with the new values for E_x */
+  profileStart(s->profile, PROFILE_PUSH);
+  s = pushParticles(s);
+  profileStop(s->profile, PROFILE_PUSH, s->param.nIons + s->param.nElectrons);
+
+  /* Open boundaries: absorbed particles out, injected ones in */
+  if (s->open != NULL) s = applyOpenBoundaries(s);
+
+  return s;
+}
+
+/* Resamples (merges / splits) the particles of every full-f species,
+   keeping their number per cell near the target (see resample.c).
+ */
+struct simulation * resampleSimulation(struct simulation *s)
+{
+  int d, nCells = s->param.nGridPoints - 1;
+  int resampleIons = !(deltaF_vth2(s->param, s->param.T_i, ION_MASS) > 0);
+  int resampleElectrons = !(deltaF_vth2(s->param, s->param.T_e, ELECTRON_MASS) > 0);
+  struct particleBuffer b;
+
+  /* Domain-decomposed mode: cells never span two domains, so every 
+     domain resamples its own particles */
+  if (s->param.nDomains > 0) {
+    #pragma omp parallel for schedule(static,1)
+    for (d=0; d<s->param.nDomains; d++) {
+      struct domain *dm = &s->dom[d];
+
+      if (resampleIons) dm->ions = resampleSpecies(dm->ions, s->ionsTarget, dm->firstCell, dm->lastCell, s->dx);
+      if (resampleElectrons) {
+        dm->electrons = resampleSpecies(dm->electrons, s->electronsTarget, dm->firstCell, dm->lastCell, s->dx);
+      }
+    }
+    return s;
+  }
+
+  if (resampleIons) {
+    b.p = s->ions; b.n = s->param.nIons;
+    b.capacity = s->open != NULL ? s->open->ionsCapacity : s->param.nIons;
+    b = resampleSpecies(b, s->ionsTarget, 0, nCells, s->dx);
+    s->ions = b.p; s->param.nIons = b.n;
+    if (s->open != NULL) resizeOpenBoundary(s->open, b.capacity, s->open->electronsCapacity);
+  }
+  if (resampleElectrons) {
+    b.p = s->electrons; b.n = s->param.nElectrons;
+    b.capacity = s->open != NULL ? s->open->electronsCapacity : s->param.nElectrons;
+    b = resampleSpecies(b, s->electronsTarget, 0, nCells, s->dx);
+    s->electrons = b.p; s->param.nElectrons = b.n;
+    if (s->open != NULL) resizeOpenBoundary(s->open, s->open->ionsCapacity, b.capacity);
+  }
+
+  /* Implicit mode: work arrays must follow the new particle numbers */
+  if (s->param.implicit) {
+    deAllocateImplicit(s->im); free(s->im);
+    s->im = allocateImplicit(s->ions, s->electrons, s->param);
+  }
+
+  return s;
+}
+
+/* Sorts the particles of both species by cell (plain explicit mode
+   only: the other modes keep particles in domains, work arrays or files).
+   Particles of a cell are then next to each other in memory, as are
+   the grid points they touch.
+ */
+struct simulation * sortSimulation(struct simulation *s)
+{
+  int nCells = s->param.nGridPoints - 1;
+  struct particle *sorted;
+
+  if (s->param.nDomains > 0 || s->param.implicit || s->param.outOfCore) return s;
+
+  /* Open boundaries: sorted into the spare arrays, which are swapped */
+  if (s->open != NULL) {
+    sorted = s->open->ionsSpare;
+    sortByCell(s->ions, sorted, s->param.nIons, nCells, s->dx);
+    s->open->ionsSpare = s->ions; s->ions = sorted;
+
+    sorted = s->open->electronsSpare;
+    sortByCell(s->electrons, sorted, s->param.nElectrons, nCells, s->dx);
+    s->open->electronsSpare = s->electrons; s->electrons = sorted;
+    return s;
+  }
+
+  sorted = allocateParticles(s->param.nIons);
+  sortByCell(s->ions, sorted, s->param.nIons, nCells, s->dx);
+  deAllocateParticles(s->ions); s->ions = sorted;
+
+  sorted = allocateParticles(s->param.nElectrons);
+  sortByCell(s->electrons, sorted, s->param.nElectrons, nCells, s->dx);
+  deAllocateParticles(s->electrons); s->electrons = sorted;
+
+  return s;
+}
+
+/* Domain-decomposed mode: writes the slices of the domains to the grid
+   and field of the simulation (the time step works on the slices only).
+   Other modes keep the grid up to date.
+ */
+struct simulation * collectGrid(struct simulation *s)
+{
+  if (s->param.nDomains > 0) {
+    collectDomains(s->dom, s->param.nDomains, s->g, s->f, s->param.nGridPoints);
+  }
+
+  return s;
+}
+
+/* Advances simulation by one time step */
+struct simulation * stepSimulation(struct simulation *s)
+{
+  struct phaseSpace *ph = s->g->phase;
+  int next = s->step + 1;
+
+  /* Phase space histograms: filled by the deposition of the last step
+     before an output that sends them (the implicit step deposits several
+     times per step, and adaptive outputs are not known ahead, so these
+     leave them to the output) */
+  if (ph != NULL && !s->param.implicit && s->cadence == NULL && next%s->param.interval == 0 &&
+      (next/s->param.interval)%ph->every == 0) {
+    armPhaseSpace(ph);
+  }
+
+  /* Other modes than explicit: profiled as a whole */
+  int other = (s->param.nDomains > 0 || s->param.implicit || s->param.outOfCore);
+
+  if (other) profileStart(s->profile, PROFILE_STEP);
+
+  /* Domain-decomposed mode: whole time step, one thread per domain */
+  if (s->param.nDomains > 0) {
+    decomposedStep(s->dom, s->g->phase, s->f->Bz, s->param, s->dx);
+    /* Probes and adaptive output read the grid after every step */
+    if (s->probes != NULL || s->cadence != NULL) s = collectGrid(s);
+  }
+  /* Implicit mode: whole time step (field and particles together) */
+  else if (s->param.implicit) {
+    implicitStep(s->im, s->ions, s->electrons, s->g, s->f, s->param, s->dx);
+  }
+  /* Out-of-core mode: one pass over the particles (push and deposition) */
+  else if (s->param.outOfCore) {
+    outOfCoreStep(s->ions, s->electrons, s->g, s->f, &s->deposit, &s->poisson, s->param, s->dx);
+  }
+  else {
+    s = explicitStep(s);
+  }
+  if (other) profileStop(s->profile, PROFILE_STEP, s->param.nIons + s->param.nElectrons);
+
+  s->step++;
+  /* Out-of-core mode deposits the pushed particles, the others those of the step before */
+  if (ph != NULL && ph->armed) {
+    finishPhaseSpace(ph, s->param.outOfCore ? s->step : s->step - 1);
+  }
+  if (s->probes != NULL) sampleProbes(s);
+  if (s->param.resampleInterval > 0 && s->step%s->param.resampleInterval == 0) {
+    s = resampleSimulation(s);
+  }
+  if (s->param.sortInterval > 0 && s->step%s->param.sortInterval == 0) {
+    s = sortSimulation(s);
+  }
+  if (s->metrics != NULL) updateMetrics(s->metrics, s);
+
+  return s;
+}
+
+/* Writes output number "output" (0: files are created) of the current state */
+void writeSimulationOutput(struct simulation *s, int output)
+{
+  struct energy e;
+
+  s = collectGrid(s);
+  /* The implicit step does not need the potential: find it for output only */
+  if (s->param.implicit) {
+    s->g->u = poisson1D(s->g->u, s->g->rho, s->param.nGridPoints, s->dx, &s->poisson);
+  }
+  if (s->param.textOutput) {
+    writeGridOutput(s->g, s->param.nGridPoints, output, s->outputPrefix);
+    writeFieldOutput(s->f, s->param.nGridPoints, output, s->outputPrefix);   
+  }
+  e = simulationEnergy(s);
+  writeEnergyOutput(e, output, s->step*s->param.dt, s->outputPrefix);
+  writeTimesOutput(output, s->step, s->step*s->param.dt, s->outputPrefix);
+  if (s->metrics != NULL) updateEnergyMetrics(s->metrics, e, s->step);
+  if (s->stream != NULL) streamSimulationOutput(s, output);
+  if (s->snapshots != NULL) writeSnapshot(s, output);
+}
+
+/* Runs the whole simulation (output loop). Returns wall time in seconds. */
+double runSimulation(struct simulation *s)
+{
+  int t, output;
+  double tStart, time;
+
+  /* Start timing */
+  tStart = omp_get_wtime();
+
+  /**** START ITERATING ****/   
+  /* Adaptive output: when the monitors say so (see cadence.c), and at the end */
+  if (s->cadence != NULL) {
+    output = 0;
+    writeSimulationOutput(s, output++);
+    while (s->step < s->totalTimeSteps) {
+      s = stepSimulation(s);
+      if (outputDue(s->cadence, s->f->E, s->param.nGridPoints, s->param) ||
+          s->step == s->totalTimeSteps) {
+        writeSimulationOutput(s, output++);
+      }
+    }
+    printf("# Adaptive output: %d outputs in %d steps\n", output, s->step);
+  }
+  else {
+    for (output=0;output<=s->nOutput;output++) { 
+      /* Write output */
+      writeSimulationOutput(s, output);
+      for (t=0; t<s->param.interval; t++) {
+        s = stepSimulation(s);
+      }
+    }
+  }
+
+  /* Stop timing */
+  time = omp_get_wtime() - tStart;
+
+  /* Ensemble members: one report at a time, headed by the member */
+  if (profilingOn(s->profile)) {
+    #pragma omp critical (profileReport)
+    {
+      if (omp_in_parallel()) printf("\n# Profile of %s*", s->outputPrefix);
+      printProfileReport(s->profile, s->param.profilePeak, s->param.profileBandwidth);
+    }
+  }
+
+  return time;
+}
+
+/* Simulation De-Allocator */
+void deAllocateSimulation(struct simulation *s)
+{
+  if (s->param.outOfCore) {
+    unmapParticles(s->ions, s->param.nIons); unmapParticles(s->electrons, s->param.nElectrons);
+  }
+  else {
+    deAllocateParticles(s->ions); deAllocateParticles(s->electrons);
+  }
+  if (s->param.nDomains > 0) {
+    deAllocateDomains(s->dom, s->param.nDomains); free(s->dom);
+  }
+  if (s->param.implicit) {
+    deAllocateImplicit(s->im); free(s->im);
+  }
+  if (s->stream != NULL) {
+    closeStream(s->stream); free(s->stream);
+  }
+  if (s->snapshots != NULL) {
+    closeSnapshots(s->snapshots); free(s->snapshots);
+  }
+  if (s->open != NULL) {
+    deAllocateOpenBoundary(s->open); free(s->open);
+  }
+  deAllocateSpecies(s);
+  if (s->cadence != NULL) {
+    deAllocateCadence(s->cadence); free(s->cadence);
+  }
+  if (s->metrics != NULL) {
+    closeMetrics(s->metrics); free(s->metrics);
+  }
+  if (s->probes != NULL) {
+    closeProbes(s->probes); free(s->probes);
+  }
+  if (s->g->phase != NULL) {
+    deAllocatePhaseSpace(s->g->phase); free(s->g->phase);
+  }
+  deAllocateGrid(s->g); free(s->g);
+  deAllocateField(s->f); free(s->f);
+  stopProfiling(s->profile); free(s->profile);
+}
@@ -0,0 +1,355 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Species Table
+ ***
+ *** The species of a run are the entries of a table built at run
+ *** time: ions and electrons (entries 0 and 1, charge and mass from
+ *** definitions.h), then the additional species of the 'K' lines of
+ *** the input file (beams, impurities), each with its own charge,
+ *** mass, weight, pusher and subcycling.
+ *** Every entry names its kernel, chosen once per step and not per
+ *** particle: ions and electrons keep the RK4 movers specialised for
+ *** their constant charge and mass (or the delta-f one), additional
+ *** species use the generic RK4 or the Boris pusher.
+ *** Push and deposition of all species are one parallel region each,
+ *** the threads going through the table species after species:
+ ***   - push: no barrier between species (a thread done with its
+ ***     block of one species goes on to the next),
+ ***   - deposition: private density and current arrays per thread
+ ***     and species (allocated once), added up in fixed thread order
+ ***     afterwards, in parallel over the grid points (same result on
+ ***     every run).
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/memory.h"
+#include "../headers/mover.h"
+#include "../headers/setup.h"
+#include "../headers/shape.h"
+#include "../headers/interpolate.h"
+#include "../headers/temperature.h"
+#include "../headers/outofcore.h"
+#include "../headers/energy.h"
+#include "../headers/phasespace.h"
+#include "../headers/definitions.h"
+
+/* Kernels of the species table */
+#define KERNEL_ION 0
+#define KERNEL_ELECTRON 1
+#define KERNEL_DELTAF 2
+#define KERNEL_RK4 3
+#define KERNEL_BORIS 4
+
+/* Quiet start bases of the additional species (ions 3, electrons 2) */
+static const int quietBases[MAX_SPECIES] = {5, 7, 11, 13, 17, 19, 23, 29};
+
+/* Fills the species table of simulation s. Returns number of entries. */
+int speciesTable(struct simulation *s, struct speciesEntry *table)
+{
+  struct parameters param = s->param;
+  struct species sp;
+  int k;
+
+  table[0].p = s->ions;
+  table[0].n = param.nIons;
+  table[0].charge = ION_CHARGE;
+  table[0].mass = ION_MASS;
+  table[0].vth2 = deltaF_vth2(param, param.T_i, ION_MASS);
+  table[0].kernel = table[0].vth2 > 0 ? KERNEL_DELTAF : KERNEL_ION;
+  table[0].subcycle = 1;
+  table[0].density = s->g->n_i;
+  table[0].current = s->g->J_i;
+
+  table[1].p = s->electrons;
+  table[1].n = param.nElectrons;
+  table[1].charge = ELECTRON_CHARGE;
+  table[1].mass = ELECTRON_MASS;
+  table[1].vth2 = deltaF_vth2(param, param.T_e, ELECTRON_MASS);
+  table[1].kernel = table[1].vth2 > 0 ? KERNEL_DELTAF : KERNEL_ELECTRON;
+  table[1].subcycle = 1;
+  table[1].density = s->g->n_e;
+  table[1].current = s->g->J_e;
+
+  for (k=0; k<param.nSpecies; k++) {
+    sp = param.species[k];
+    table[k+2].p = s->speciesParticles[k];
+    table[k+2].n = sp.number;
+    table[k+2].charge = sp.charge;
+    table[k+2].mass = sp.mass;
+    table[k+2].vth2 = 0.0;
+    table[k+2].kernel = sp.pusher == 1 ? KERNEL_BORIS : KERNEL_RK4;
+    table[k+2].subcycle = sp.subcycle;
+    table[k+2].density = s->speciesDensity[k];
+    table[k+2].current = s->speciesCurrent[k];
+  }
+
+  return param.nSpecies + 2;
+}
+
+/* Checks the additional species (drops those that make no sense) */
+struct parameters checkSpecies(struct parameters param)
+{
+  int k, n = 0;
+  struct species sp;
+
+  for (k=0; k<param.nSpecies; k++) {
+    sp = param.species[k];
+    if (sp.number < 1 || sp.mass <= 0 || sp.weight <= 0) {
+      printf("# Note: species %s needs particles, mass and weight > 0 (dropped).\n", sp.name);
+      continue;
+    }
+    if (sp.subcycle < 1) sp.subcycle = 1;
+    if (sp.pusher != 1) sp.pusher = 0;
+    param.species[n++] = sp;
+  }
+  param.nSpecies = n;
+
+  return param;
+}
+
+/* Initializes the particles of additional species "index": uniform
+   positions, Maxwellian velocities (along x) around the drift */
+static struct particle * setupSpecies(struct particle *p, struct species sp, int index,
+                                      struct parameters param, double dx)
+{
+  long i;
+
+  for (i=0; i<sp.number; i++) {
+    p[i] = setParticleX(p[i], (i+1)*(param.gridEnd - param.gridStart)/(sp.number+1), dx);
+#ifndef MIXED_PRECISION
+    p[i].r.y = 0.0;
+#endif
+    p[i].v.x = 0.0;
+    p[i].v.y = 0.0;
+    p[i].w = sp.weight;
+  }
+
+  if (param.quietStart) {
+    p = quietMaxwell_Boltzmann(p, sp.T, sp.number, sp.mass, quietBases[index], param.quietMirror);
+  }
+  else p = Maxwell_Boltzmann(p, sp.T, sp.number, sp.mass);
+
+  for (i=0; i<sp.number; i++) {
+    p[i].v.x += sp.drift;
+  }
+
+  return p;
+}
+
+/* Allocates the private deposition arrays of every thread (as many as
+   can run now) for nSpecies species of nGrid points */
+static struct depositBuffers allocateDeposit(int nSpecies, int nGrid)
+{
+  struct depositBuffers b;
+  size_t size = (size_t)nSpecies*nGrid;
+
+  b.threads = omp_get_max_threads();
+  b.used = 0;
+  b.density = (double *)allocateArray(b.threads*size*sizeof(double));
+  b.current = (struct vector2D *)allocateArray(b.threads*size*sizeof(struct vector2D));
+
+  return b;
+}
+
+/* Allocates and sets up the additional species of simulation s */
+struct simulation * allocateSpecies(struct simulation *s)
+{
+  int k, nGrid = s->param.nGridPoints;
+  struct species sp;
+
+  for (k=0; k<s->param.nSpecies; k++) {
+    sp = s->param.species[k];
+    s->speciesParticles[k] = allocateParticles(sp.number);
+    s->speciesDensity[k] = (double *)allocateArray(nGrid*sizeof(double));
+    s->speciesCurrent[k] = (struct vector2D *)allocateArray(nGrid*sizeof(struct vector2D));
+
+    /* Global random number generator: see setupSimulation */
+    #pragma omp critical (particleSetup)
+    s->speciesParticles[k] = setupSpecies(s->speciesParticles[k], sp, k, s->param, s->dx);
+  }
+
+  s->deposit = allocateDeposit(s->param.nSpecies + 2, nGrid);
+
+  return s;
+}
+
+/* Loop of one kernel over the particles of entry e. Particles are
+   independent: static schedule (the pages of the particle arrays are
+   placed to match it, see setMemoryPolicy) */
+#define PUSH_LOOP(move)                                                 \
+  _Pragma("omp for schedule(static) nowait")                            \
+  for (i=0; i<e.n; i++) {                                               \
+    e.p[i] = move;                                                      \
+    if (!open) e.p[i] = checkPeriodic(e.p[i], param.gridStart, param.gridEnd, dx); \
+  }
+
+/* Moves the particles of every species due at this step (subcycled
+   species every "subcycle" steps, with subcycle*dt), in one parallel
+   region. Periodic particle boundaries unless "open".
+   Boris species: the first push (step 0) takes the loaded velocities
+   half a step back first (see startBoris).
+ */
+void pushAllSpecies(struct speciesEntry *table, int nSpecies, struct field *f,
+                    struct parameters param, double dx, int step, int open)
+{
+  int k;
+  long i;
+
+  #pragma omp parallel private(k)
+  for (k=0; k<nSpecies; k++) {
+    struct speciesEntry e = table[k];
+    double h = e.subcycle*param.dt;
+
+    if (step%e.subcycle != 0) continue;
+
+    switch (e.kernel) {
+    case KERNEL_ION:      PUSH_LOOP(moveIon(e.p[i], f, dx, h)); break;
+    case KERNEL_ELECTRON: PUSH_LOOP(moveElectron(e.p[i], f, dx, h)); break;
+    case KERNEL_DELTAF:   PUSH_LOOP(moveParticleDeltaF(e.p[i], e.charge, e.mass, e.vth2, f, dx, h)); break;
+    case KERNEL_BORIS:
+      if (step == 0) {
+        PUSH_LOOP(moveParticleBoris(startBoris(e.p[i], e.charge, e.mass, f, dx, h), e.charge, e.mass, f, dx, h));
+      }
+      else {
+        PUSH_LOOP(moveParticleBoris(e.p[i], e.charge, e.mass, f, dx, h));
+      }
+      break;
+    default:              PUSH_LOOP(moveParticle(e.p[i], e.charge, e.mass, f, dx, h)); break;
+    }
+  }
+}
+
+/* Deposits the particles of every species (as nShape, jShape) into
+   their density and current, then finds rho and J of all species.
+   Ions and electrons are also added to the phase space histograms,
+   if armed. b: private arrays of every thread and species (see
+   allocateDeposit).
+ */
+void depositAllSpecies(struct speciesEntry *table, int nSpecies, struct depositBuffers *b,
+                       struct grid *g, struct parameters param, double dx)
+{
+  int k, point, nThreads, nGrid = param.nGridPoints;
+  size_t size = (size_t)nSpecies*nGrid;
+
+  /* Never more threads than arrays */
+  nThreads = omp_get_max_threads();
+  if (nThreads > b->threads) nThreads = b->threads;
+
+  #pragma omp parallel private(k) num_threads(nThreads)
+  {
+    long i;
+    int m, first, cell, point, t = omp_get_thread_num();
+    double x, w[SHAPE_POINTS];
+
+    /* Threads given fewer than asked: the arrays of the others stay
+       out of the sum below */
+    #pragma omp single
+    b->used = omp_get_num_threads();
+
+    memset(b->density + t*size, 0, size*sizeof(double));
+    memset(b->current + t*size, 0, size*sizeof(struct vector2D));
+
+    for (k=0; k<nSpecies; k++) {
+      double *nt = b->density + t*size + (size_t)k*nGrid;
+      struct vector2D *jt = b->current + t*size + (size_t)k*nGrid;
+      double *h = k < 2 ? phaseSpaceBins(g->phase, t, k) : NULL;
+      struct particle *p = table[k].p;
+
+      #pragma omp for schedule(static) nowait
+      for (i=0; i<table[k].n; i++) {
+        cell = PARTICLE_CELL(p[i], dx);
+        x = PARTICLE_X(p[i], dx);
+        first = shapeWeights(x, cell, dx, w);
+        for (m=0; m<SHAPE_POINTS; m++) {
+          point = boundaryPoint(first + m, nGrid, param.openBoundaries);
+          nt[point] += w[m]*p[i].w/dx;
+          jt[point].x += w[m]*p[i].w*p[i].v.x/dx;
+          jt[point].y += w[m]*p[i].w*p[i].v.y/dx;
+        }
+
+        if (h != NULL) addToPhaseSpace(h, g->phase, k, x, p[i].v.x, p[i].w);
+      }
+    }
+  }
+
+  /* Add up threads, in parallel over the grid points but in fixed
+     thread order at every point (same result on every run) */
+  #pragma omp parallel for schedule(static) private(k)
+  for (point=0; point<nGrid; point++) {
+    int t;
+    size_t at;
+
+    for (k=0; k<nSpecies; k++) {
+      double n = 0;
+      struct vector2D j = {0, 0};
+
+      for (t=0; t<b->used; t++) {
+        at = t*size + (size_t)k*nGrid + point;
+        n += b->density[at];
+        j.x += b->current[at].x;
+        j.y += b->current[at].y;
+      }
+      table[k].density[point] = n;
+      table[k].current[point] = j;
+    }
+  }
+
+  for (k=0; k<nSpecies; k++) {
+    finishDensities(table[k].density, table[k].current, nGrid, param.openBoundaries, dx);
+
+    /* delta-f mode: particles carry only the perturbation */
+    if (table[k].kernel == KERNEL_DELTAF) {
+      table[k].density = addBackgroundDensity(table[k].density, table[k].n, nGrid,
+                                              param.gridEnd - param.gridStart);
+    }
+  }
+
+  /* Charge and current density of all species */
+  for (point=0; point<nGrid; point++) {
+    g->rho[point] = g->n_i[point]*ION_CHARGE + g->n_e[point]*ELECTRON_CHARGE;
+    g->J[point].x = g->J_i[point].x*ION_CHARGE + g->J_e[point].x*ELECTRON_CHARGE;
+    g->J[point].y = g->J_i[point].y*ION_CHARGE + g->J_e[point].y*ELECTRON_CHARGE;
+  }
+  for (k=2; k<nSpecies; k++) {
+    for (point=0; point<nGrid; point++) {
+      g->rho[point] += table[k].density[point]*table[k].charge;
+      g->J[point].x += table[k].current[point].x*table[k].charge;
+      g->J[point].y += table[k].current[point].y*table[k].charge;
+    }
+  }
+}
+
+/* Kinetic energy of the additional species of simulation s.
+   Boris species count their leapfrog velocities, half a step (of
+   subcycle*dt) behind the time of the output.
+ */
+double speciesEnergy(struct simulation *s)
+{
+  int k;
+  double e = 0;
+
+  for (k=0; k<s->param.nSpecies; k++) {
+    e += kineticEnergy(s->speciesParticles[k], s->param.species[k].number,
+                       s->param.species[k].mass, 0);
+  }
+
+  return e;
+}
+
+/* Frees the additional species of simulation s */
+void deAllocateSpecies(struct simulation *s)
+{
+  int k;
+
+  for (k=0; k<s->param.nSpecies; k++) {
+    deAllocateParticles(s->speciesParticles[k]);
+    deAllocateArray(s->speciesDensity[k]);
+    deAllocateArray(s->speciesCurrent[k]);
+  }
+  deAllocateArray(s->deposit.density);
+  deAllocateArray(s->deposit.current);
+}
@@ -0,0 +1,346 @@
+/*******************************************************************
+ *** PIC 1d2v electromagnetic: Streaming Output
+ ***
+ *** Sends grid snapshots as framed binary data to a FIFO or to a
+ *** local (Unix domain) socket, for live viewers
+ *** (see python/stream_viewer.py). Every variable is decimated
+ *** in time (sent every N outputs) and in space (every N-th grid
+ *** point, or averaged over bins of N points), as set in input.txt.
+ ***
+ *** Frame layout (native byte order):
+ ***   header:    char magic[4] = "PICF", int32 frame size in bytes,
+ ***              int32 output, int32 step, double time, double dx,
+ ***              int32 number of variables, int32 grid points,
+ ***              int32 number of histograms, int32 (unused)
+ ***   variables: char name[8], int32 points, int32 stride,
+ ***              int32 bins, int32 every, double values[points]
+ ***   histograms (phase space f(x, v_x), see phasespace.c):
+ ***              char name[8] ("f_i", "f_e"), int32 nx, int32 nv,
+ ***              int32 step of the particles, int32 (unused),
+ ***              double xMin, xMax, vMin, vMax,
+ ***              double values[nx*nv] (index ix*nv + iv)
+ ***
+ *** The simulation never waits for a viewer: it connects when
+ *** the viewer is there (FIFO opened for reading, or socket
+ *** listening), frames are dropped while the viewer is slow, and
+ *** a viewer that goes away is reconnected at a later output.
+ *** Once a frame is started it is completed, so a viewer always
+ *** sees whole frames.
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+
+#include "../headers/structs.h"
+#include "../headers/phasespace.h"
+
+#define SOCKET_PREFIX "unix:"
+/* Longest wait (ms) for a slow viewer to take the rest of a started
+   frame, in all (a viewer that keeps taking a little at a time is
+   given up, as one that takes nothing) */
+#define FRAME_TIMEOUT 1000
+
+/* Frame and variable headers (see top of file) */
+struct frameHeader {
+  char magic[4];
+  int32_t size, output, step;
+  double time, dx;
+  int32_t nVariables, nGridPoints;
+  int32_t nHistograms, unused;
+};
+
+struct variableHeader {
+  char name[8];
+  int32_t nPoints, stride, bins, every;
+};
+
+struct histogramHeader {
+  char name[8];
+  int32_t nx, nv, step, unused;
+  double xMin, xMax, vMin, vMax;
+};
+
+/* Names of the grid variables that can be streamed */
+static const char *variableNames[MAX_STREAM_VARIABLES] =
+  {"rho", "u", "n_i", "n_e", "E_x", "E_y", "J_x", "J_y", "Bz"};
+
+/* Finds grid variable "name": values are a[0], a[step], a[2*step]...
+   Returns 0 for an unknown name. */
+static int variableData(struct simulation *s, const char *name, double **a, int *step)
+{
+  *step = 1;
+  if (strcmp(name, "rho") == 0) *a = s->g->rho;
+  else if (strcmp(name, "u") == 0) *a = s->g->u;
+  else if (strcmp(name, "n_i") == 0) *a = s->g->n_i;
+  else if (strcmp(name, "n_e") == 0) *a = s->g->n_e;
+  else if (strcmp(name, "Bz") == 0) *a = s->f->Bz;
+  else {
+    *step = 2;
+    if (strcmp(name, "E_x") == 0) *a = &s->f->E[0].x;
+    else if (strcmp(name, "E_y") == 0) *a = &s->f->E[0].y;
+    else if (strcmp(name, "J_x") == 0) *a = &s->g->J[0].x;
+    else if (strcmp(name, "J_y") == 0) *a = &s->g->J[0].y;
+    else return 0;
+  }
+  return 1;
+}
+
+/* Number of values sent for nGridPoints points */
+static int decimatedPoints(struct streamVariable v, int nGridPoints)
+{
+  return v.bins ? (nGridPoints + v.stride - 1)/v.stride : (nGridPoints - 1)/v.stride + 1;
+}
+
+/* Checks the streamed variables (unknown names are removed,
+   strides and intervals at least 1). Without any "V" lines,
+   all variables are streamed at every output, at full resolution.
+ */
+struct parameters checkStreamVariables(struct parameters param)
+{
+  int i, k, n = 0;
+
+  if (param.nStreamVariables == 0) {
+    for (k=0; k<MAX_STREAM_VARIABLES; k++) {
+      strcpy(param.streamVariables[k].name, variableNames[k]);
+      param.streamVariables[k].every = 1;
+      param.streamVariables[k].stride = 1;
+      param.streamVariables[k].bins = 0;
+    }
+    param.nStreamVariables = MAX_STREAM_VARIABLES;
+    return param;
+  }
+
+  for (i=0; i<param.nStreamVariables; i++) {
+    struct streamVariable v = param.streamVariables[i];
+
+    for (k=0; k<MAX_STREAM_VARIABLES; k++) {
+      if (strcmp(v.name, variableNames[k]) == 0) break;
+    }
+    if (k == MAX_STREAM_VARIABLES) {
+      printf("# Note: unknown stream variable \"%s\" (ignored).\n", v.name);
+      continue;
+    }
+    if (v.every < 1) v.every = 1;
+    if (v.stride < 1) v.stride = 1;
+    v.bins = (v.bins != 0);
+    param.streamVariables[n++] = v;
+  }
+  param.nStreamVariables = n;
+
+  return param;
+}
+
+/* Tries to connect the stream to "target" (FIFO path, created if
+   missing, or "unix:<path>" of a listening socket).
+   Leaves fd = -1 if no viewer is there yet.
+ */
+void connectStream(struct outputStream *st, char *target)
+{
+  st->socket = (strncmp(target, SOCKET_PREFIX, strlen(SOCKET_PREFIX)) == 0);
+
+  if (st->socket) {
+    struct sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, target + strlen(SOCKET_PREFIX), sizeof(address.sun_path) - 1);
+
+    st->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (st->fd < 0) return;
+    if (connect(st->fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+      close(st->fd); st->fd = -1;
+      return;
+    }
+    fcntl(st->fd, F_SETFL, fcntl(st->fd, F_GETFL) | O_NONBLOCK);
+  }
+  else {
+    struct stat info;
+
+    if (stat(target, &info) != 0) mkfifo(target, 0644);
+    /* Fails (ENXIO) while no reader has the FIFO open */
+    st->fd = open(target, O_WRONLY | O_NONBLOCK);
+  }
+}
+
+/* Opens the stream to "target" (see connectStream) */
+struct outputStream * openStream(char *target)
+{
+  struct outputStream *st = (struct outputStream *)malloc(sizeof(struct outputStream));
+
+  /* A FIFO whose reader has gone away raises SIGPIPE on write:
+     the write should just fail (EPIPE) instead */
+  signal(SIGPIPE, SIG_IGN);
+
+  st->nFrames = 0;
+  st->nDropped = 0;
+  st->buffer = NULL;
+  st->capacity = 0;
+  connectStream(st, target);
+
+  return st;
+}
+
+/* Writes size bytes of buffer to the stream.
+   Returns 0 if the frame was dropped (nothing written, viewer busy),
+   -1 if the viewer has gone away (stream closed), 1 on success.
+ */
+static int sendFrame(struct outputStream *st, size_t size)
+{
+  size_t done = 0;
+  ssize_t n;
+  struct pollfd p;
+  double deadline = 0;
+  int wait;
+
+  while (done < size) {
+    if (st->socket) n = send(st->fd, st->buffer + done, size - done, MSG_NOSIGNAL);
+    else n = write(st->fd, st->buffer + done, size - done);
+
+    if (n > 0) {
+      done += n;
+    }
+    else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && done == 0) {
+      return 0;
+    }
+    else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      /* Frame started: wait for the viewer to take the rest, until
+         FRAME_TIMEOUT after the first wait */
+      if (deadline == 0) deadline = omp_get_wtime() + 1e-3*FRAME_TIMEOUT;
+      wait = (int)(1e3*(deadline - omp_get_wtime()));
+      if (wait <= 0) break;
+      p.fd = st->fd; p.events = POLLOUT;
+      if (poll(&p, 1, wait) <= 0) break;
+    }
+    else break;
+  }
+  if (done == size) return 1;
+
+  close(st->fd); st->fd = -1;
+  return -1;
+}
+
+/* Sends the variables (and phase space histograms) due at output
+   number "output", as one frame */
+void streamSimulationOutput(struct simulation *s, int output)
+{
+  struct outputStream *st = s->stream;
+  struct phaseSpace *ph = s->g->phase;
+  struct frameHeader h;
+  struct variableHeader vh;
+  struct histogramHeader hh;
+  struct streamVariable v;
+  size_t size, position, histogramSize = 0;
+  int i, j, k, n, nPoints, step, nVariables, nHistograms = 0;
+  double *a, value;
+
+  if (st->fd < 0) connectStream(st, s->param.streamTarget);
+  if (st->fd < 0) {
+    if (ph != NULL) ph->ready = 0;
+    return;
+  }
+
+  /* Histograms: from the last deposition, or from a pass of their own */
+  if (ph != NULL && output % ph->every == 0) {
+    if (!ph->ready) phaseSpaceSweep(s);
+    nHistograms = 2;
+    histogramSize = (size_t)ph->nx*ph->nv*sizeof(double);
+  }
+
+  /* Frame size */
+  size = sizeof(h);
+  nVariables = 0;
+  for (i=0; i<s->param.nStreamVariables; i++) {
+    v = s->param.streamVariables[i];
+    if (output % v.every != 0) continue;
+    size += sizeof(vh) + decimatedPoints(v, s->param.nGridPoints)*sizeof(double);
+    nVariables++;
+  }
+  size += nHistograms*(sizeof(hh) + histogramSize);
+  if (nVariables + nHistograms == 0) return;
+
+  if ((long)size > st->capacity) {
+    st->buffer = (char *)realloc(st->buffer, size);
+    st->capacity = size;
+  }
+
+  /* Header */
+  memcpy(h.magic, "PICF", 4);
+  h.size = (int32_t)size;
+  h.output = output;
+  h.step = s->step;
+  h.time = s->step*s->param.dt;
+  h.dx = s->dx;
+  h.nVariables = nVariables;
+  h.nGridPoints = s->param.nGridPoints;
+  h.nHistograms = nHistograms;
+  h.unused = 0;
+  memcpy(st->buffer, &h, sizeof(h));
+  position = sizeof(h);
+
+  /* Variables: decimated values */
+  for (i=0; i<s->param.nStreamVariables; i++) {
+    v = s->param.streamVariables[i];
+    if (output % v.every != 0 || !variableData(s, v.name, &a, &step)) continue;
+    nPoints = decimatedPoints(v, s->param.nGridPoints);
+
+    memset(&vh, 0, sizeof(vh));
+    strncpy(vh.name, v.name, sizeof(vh.name));
+    vh.nPoints = nPoints;
+    vh.stride = v.stride;
+    vh.bins = v.bins;
+    vh.every = v.every;
+    memcpy(st->buffer + position, &vh, sizeof(vh));
+    position += sizeof(vh);
+
+    for (j=0; j<nPoints; j++) {
+      if (v.bins) {
+        value = 0; n = 0;
+        for (k=j*v.stride; k<(j+1)*v.stride && k<s->param.nGridPoints; k++, n++) {
+          value += a[k*step];
+        }
+        value /= n;
+      }
+      else value = a[j*v.stride*step];
+      memcpy(st->buffer + position, &value, sizeof(double));
+      position += sizeof(double);
+    }
+  }
+
+  /* Histograms of ions, then electrons */
+  for (i=0; i<nHistograms; i++) {
+    memset(&hh, 0, sizeof(hh));
+    strcpy(hh.name, i == 0 ? "f_i" : "f_e");
+    hh.nx = ph->nx;
+    hh.nv = ph->nv;
+    hh.step = ph->step;
+    hh.xMin = ph->xMin;
+    hh.xMax = ph->xMin + ph->length;
+    hh.vMin = -ph->vMax[i];
+    hh.vMax = ph->vMax[i];
+    memcpy(st->buffer + position, &hh, sizeof(hh));
+    position += sizeof(hh);
+    memcpy(st->buffer + position, ph->f + i*(size_t)ph->nx*ph->nv, histogramSize);
+    position += histogramSize;
+  }
+  if (ph != NULL) ph->ready = 0;
+
+  if (sendFrame(st, size) == 1) st->nFrames++;
+  else st->nDropped++;
+}
+
+/* Closes the stream */
+void closeStream(struct outputStream *st)
+{
+  if (st->fd >= 0) close(st->fd);
+  free(st->buffer);
+}
@@ -34,13 +34,13 @@ double BoxMuller()
    To Given Array (of structures) With Values From Normal Distribution
    (-> Initial Average = 0, Initial Standard Deviation = 1)
  */
-struct particle * Average_StdDev(struct particle *p, double average, double stddev, int number) 
+struct particle * Average_StdDev(struct particle *p, double average, double stddev, long number) 
 {
-  int i;
+  long i;
 
   /* Apply Standard Deviation First */
   for (i=0; i<number; i++) {
-    p[i].v.x *= sqrt(stddev);
+    p[i].v.x *= stddev;
   }
 
   /* Apply Average Second */
@@ -52,9 +52,9 @@ struct particle * Average_StdDev(struct particle *p, double average, double stdd
 }
 
 /* Calculates average from array */
-double average (struct particle *p, int size) 
+double average (struct particle *p, long size) 
 {
-  int i;
+  long i;
   double av = 0;
 
   for (i=0; i<size; i++) {
@@ -67,9 +67,9 @@ double average (struct particle *p, int size)
 }
 
 /* Calculates Standard Deviation from array, given average */
-double standardDev(struct particle *p, double average, int size)
+double standardDev(struct particle *p, double average, long size)
 {
-  int i;
+  long i;
   double stddev = 0;
 
   for (i=0; i<size; i++) {
@@ -82,9 +82,9 @@ double standardDev(struct particle *p, double average, int size)
 }
 
 /* Sets Maxwell-Boltzmann velocities to array of particles of given mass (struct particle) */
-struct particle * Maxwell_Boltzmann(struct particle *p, double T, int number, double mass) {
+struct particle * Maxwell_Boltzmann(struct particle *p, double T, long number, double mass) {
   
-  int i;
+  long i;
 
   /* Seed RNG */
   //srand(time(NULL));
@@ -119,6 +119,108 @@ struct particle * Maxwell_Boltzmann(struct particle *p, double T, int number, do
 
   return p;
 }
+/*********************************************************************
+ Quiet start: Maxwell - Boltzmann velocities without sampling noise
+ *********************************************************************/
+/* Radical inverse of i in the given base (van der Corput sequence):
+   the digits of i mirrored about the point, e.g. base 2: 
+   1, 2, 3, 4... -> 1/2, 1/4, 3/4, 1/8... Every prefix of the sequence 
+   fills [0,1) evenly. */
+double radicalInverse(long i, int base)
+{
+  double r = 0, f = 1.0/base;
+
+  while (i > 0) {
+    r += f*(i % base);
+    i /= base;
+    f /= base;
+  }
+
+  return r;
+}
+
+/* Inverse of the standard normal CDF, 0 < u < 1: rational
+   approximation (P. J. Acklam, relative error 1e-9), polished by a
+   Newton step on erfc to full double precision */
+double inverseNormal(double u)
+{
+  static const double a[6] = {-3.969683028665376e+01, 2.209460984245205e+02,
+    -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+  static const double b[5] = {-5.447609879822406e+01, 1.615858368580409e+02,
+    -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+  static const double c[6] = {-7.784894002430293e-03, -3.223964580411365e-01,
+    -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+  static const double d[4] = {7.784695709041462e-03, 3.224671290700398e-01,
+    2.445134137142996e+00, 3.754408661907416e+00};
+  double q, r, x;
+
+  if (u < 0.02425) {
+    q = sqrt(-2*log(u));
+    x = (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+        ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+  }
+  else if (u > 1 - 0.02425) {
+    q = sqrt(-2*log(1 - u));
+    x = -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+         ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+  }
+  else {
+    q = u - 0.5;
+    r = q*q;
+    x = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q /
+        (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+  }
+
+  /* Newton step: solve Phi(x) = u */
+  x -= (0.5*erfc(-x/M_SQRT2) - u)*sqrt(2*M_PI)*exp(0.5*x*x);
+
+  return x;
+}
+
+/* Sets Maxwell-Boltzmann velocities to array of particles of given mass,
+   without random numbers (quiet start): particle i gets the velocity
+   whose CDF value is the radical inverse of i+1 in "base".
+   Since positions are evenly spaced in i, the particles form a
+   Hammersley set in (x, v_x): every cell sees the whole distribution.
+   Different species should use different (prime) bases, so that
+   their velocities are not correlated.
+   mirror: neighbouring particles (2j, 2j+1) get +v and -v, v from the
+   half Maxwellian, so the mean velocity is exactly zero (an unpaired
+   last particle is left at rest).
+ */
+struct particle * quietMaxwell_Boltzmann(struct particle *p, double T, long number, double mass,
+                                         int base, int mirror)
+{
+  long i;
+  double vth = sqrt((K_B*T)/mass);
+
+  for (i=0; i<number; i++) {
+    if (!mirror) {
+      p[i].v.x = vth*inverseNormal(radicalInverse(i + 1, base));
+    }
+    else if (i == number - 1 && i % 2 == 0) {
+      p[i].v.x = 0.0;
+    }
+    else {
+      p[i].v.x = vth*inverseNormal(0.5 + 0.5*radicalInverse(i/2 + 1, base));
+      if (i % 2 == 1) p[i].v.x = -p[i].v.x;
+    }
+  }
+
+  return p;
+}
+
+/* delta-f mode: Returns the squared thermal speed (kT/m) of the
+   Maxwellian f_0 of a species, or 0 if the species is an ordinary
+   (full-f) species. Cold species (T = 0) are always full-f.
+ */
+double deltaF_vth2(struct parameters param, double T, double mass)
+{
+  if (!param.deltaF || T <= 0) return 0;
+
+  return (K_B*T)/mass;
+}
+
 /*********************************************************************
  Maxwell - Boltzmann Velocity Distribution Functions (END)
  *********************************************************************/
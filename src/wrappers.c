@@ -7,21 +7,32 @@
 #include "../headers/structs.h"
 #include "../headers/poisson.h"
 #include "../headers/interpolate.h"
+#include "../headers/profile.h"
 
 /* 
   Evaluates grid quantities from particles
+  (phases timed in prof, Poisson sweeps counted in stats)
 */
 struct grid * fromParticlesToGrid(struct grid *g, struct particle *ions, struct particle *electrons, 
-                                             struct parameters param, double dx) 
+                                             struct parameters param, double dx,
+                                             struct profile *prof, struct poissonStats *stats) 
 {
+  long iterations = stats->iterations;
+
   /* Charge (rho) interpolation, from particles to grid */
+  profileStart(prof, PROFILE_RHO);
   g->rho = interpolateRho (g, ions, electrons, param, dx);
+  profileStop(prof, PROFILE_RHO, param.nIons + param.nElectrons);
 
   /* Solution of Poisson Equation: rho -> u -> E_x */
-  g->u = poisson1D (g->u, g->rho, param.nGridPoints, dx);
+  profileStart(prof, PROFILE_POISSON);
+  g->u = poisson1D (g->u, g->rho, param.nGridPoints, dx, stats);
+  profileStop(prof, PROFILE_POISSON, (double)(stats->iterations - iterations)*param.nGridPoints);
 
   /* Current density (J) interpolation, from particles to grid */
+  profileStart(prof, PROFILE_J);
   g->J = interpolateJ (g, ions, electrons, param, dx);
+  profileStop(prof, PROFILE_J, param.nIons + param.nElectrons);
 
   return g;
 }